@@ -0,0 +1,605 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "bench.h"
+
+#include "json-toolkit/columnar.h"
+#include "json-toolkit/deduplication.h"
+#include "json-toolkit/document.h"
+#include "json-toolkit/json.h"
+#include "json-toolkit/parsing.h"
+#include "json-toolkit/persistent.h"
+#include "json-toolkit/stream-writer.h"
+#include "json-toolkit/stringify.h"
+
+#include <iostream>
+#include <unordered_set>
+
+// Builds an array of `n` scalar values (integers, numbers, booleans and nulls).
+static json::Array build_scalars(int n)
+{
+  json::Array result;
+
+  for (int i(0); i < n; ++i)
+  {
+    switch (i % 4)
+    {
+    case 0: result.push(i); break;
+    case 1: result.push(i / 3.0); break;
+    case 2: result.push(i % 3 == 0); break;
+    default: result.push(nullptr); break;
+    }
+  }
+
+  return result;
+}
+
+static const char* field_names[] = { "id", "name", "enabled", "ratio", "parent", "created_at", "owner", "tags" };
+
+// Builds an array of `n` objects with 8 fields.
+static json::Array build_objects(int n)
+{
+  json::Array result;
+
+  for (int i(0); i < n; ++i)
+  {
+    json::Object obj;
+
+    for (const char* name : field_names)
+      obj[name] = i;
+
+    result.push(obj);
+  }
+
+  return result;
+}
+
+static std::string generate_numbers(int n)
+{
+  std::string result = "[";
+
+  for (int i(0); i < n; ++i)
+    result += std::to_string(i) + ", " + std::to_string(i / 7.0) + ", ";
+
+  result += "0]";
+  return result;
+}
+
+// An array of `n` numbers, as found in time series.
+static std::string generate_series(int n)
+{
+  std::string result = "[";
+
+  for (int i(0); i < n; ++i)
+    result += std::to_string(i / 7.0) + ", ";
+
+  result += "0.0]";
+  return result;
+}
+
+// An array of `n` records whose keys are repeated.
+static std::string generate_records(int n)
+{
+  std::string result = "[";
+
+  for (int i(0); i < n; ++i)
+  {
+    if (i > 0)
+      result += ", ";
+
+    result += "{ \"id\": " + std::to_string(i) + ", \"name\": \"r" + std::to_string(i) + "\", ";
+    result += "\"creation_timestamp\": " + std::to_string(i) + ", \"last_modification_timestamp\": " + std::to_string(i) + ", ";
+    result += "\"is_visible_to_everyone\": true, \"owner_identifier\": " + std::to_string(i % 100) + " }";
+  }
+
+  result += "]";
+  return result;
+}
+
+// An array of `n` log entries with long messages.
+static std::string generate_logs(int n)
+{
+  std::string result = "[";
+
+  for (int i(0); i < n; ++i)
+  {
+    if (i > 0)
+      result += ", ";
+
+    result += "{ \"level\": \"info\", \"logger\": \"http.server.requests\", ";
+    result += "\"message\": \"GET /api/v2/items/" + std::to_string(i) + " completed with status 200 in 12 ms for client 10.0.3.17\", ";
+    result += "\"context\": \"user agent: \\\"Mozilla/5.0 (X11; Linux x86_64)\\\"\\n\" }";
+  }
+
+  result += "]";
+  return result;
+}
+
+// A request-sized document with nested objects and arrays.
+static std::string generate_request()
+{
+  std::string result = "{ \"items\": [";
+
+  for (int i(0); i < 50; ++i)
+  {
+    if (i > 0)
+      result += ", ";
+
+    result += "{ \"id\": " + std::to_string(i) + ", \"label\": \"item " + std::to_string(i) + "\", ";
+    result += "\"price\": " + std::to_string(i * 1.25) + ", \"tags\": [\"a\", \"b\"] }";
+  }
+
+  result += "], \"user\": { \"name\": \"someone\", \"admin\": false } }";
+  return result;
+}
+
+// Copies all the arrays and objects of `value`.
+static json::Json deep_copy(const json::Json& value)
+{
+  if (value.isArray())
+  {
+    json::Array result;
+    result.data().reserve(value.length());
+
+    for (const json::Json& e : json::JsonView(value).elements())
+      result.push(deep_copy(e));
+
+    return result;
+  }
+  else if (value.isObject())
+  {
+    json::Object result;
+
+    for (const auto& f : json::JsonView(value).fields())
+      result.insert(f.first, deep_copy(f.second));
+
+    return result;
+  }
+
+  return value;
+}
+
+// Counts the scalars of `value`, testing the type of each value in turn.
+static size_t count_scalars(json::JsonView value)
+{
+  size_t result = 0;
+
+  if (value.isArray())
+  {
+    for (int i(0); i < value.length(); ++i)
+      result += count_scalars(value.at(i));
+  }
+  else if (value.isObject())
+  {
+    for (const auto& f : value.fields())
+      result += count_scalars(f.second);
+  }
+  else if (value.isNull())
+    result += 1;
+  else if (value.isBoolean())
+    result += value.toBool() ? 1 : 1;
+  else if (value.isInteger())
+    result += value.toInt() != 0 ? 1 : 1;
+  else if (value.isNumber())
+    result += value.toNumber() != 0 ? 1 : 1;
+  else if (value.isString())
+    result += value.toString().empty() ? 1 : 1;
+
+  return result;
+}
+
+// Counts the scalars of the visited value.
+struct ScalarCounter
+{
+  size_t operator()(std::nullptr_t) const { return 1; }
+  size_t operator()(bool val) const { return val ? 1 : 1; }
+  size_t operator()(int val) const { return val != 0 ? 1 : 1; }
+  size_t operator()(double val) const { return val != 0 ? 1 : 1; }
+  size_t operator()(const std::string& str) const { return str.empty() ? 1 : 1; }
+
+  size_t operator()(json::ArrayView array) const
+  {
+    size_t result = 0;
+
+    for (int i(0); i < array.length(); ++i)
+      result += json::visit(*this, array.at(i));
+
+    return result;
+  }
+
+  size_t operator()(const json::ObjectStorage& fields) const
+  {
+    size_t result = 0;
+
+    for (const auto& f : fields)
+      result += json::visit(*this, f.second);
+
+    return result;
+  }
+};
+
+// Counts the bytes written by a StreamWriterBackend.
+struct CountingSink
+{
+  size_t size = 0;
+
+  void write(const char*, size_t n) { size += n; }
+  void write(const char*, size_t first, const char*, size_t second) { size += first + second; }
+};
+
+// An array of `n` services sharing a few configurations.
+static std::string generate_configs(int n)
+{
+  std::string result = "[";
+
+  for (int i(0); i < n; ++i)
+  {
+    if (i > 0)
+      result += ", ";
+
+    result += "{ \"service\": \"service-" + std::to_string(i) + "\", \"status\": \"" + (i % 3 ? "running" : "stopped") + "\", ";
+    result += "\"retry\": { \"attempts\": " + std::to_string(i % 4) + ", \"backoff\": [100, 200, 400, 800], \"policy\": \"exponential-with-jitter\" }, ";
+    result += "\"limits\": { \"cpu\": \"500m\", \"memory\": \"256Mi\", \"labels\": [\"production\", \"europe-west\"] } }";
+  }
+
+  result += "]";
+  return result;
+}
+
+template<typename F>
+static void run_documents(const char* name, int count, F&& f)
+{
+  bench::reset_peak();
+
+  double t = bench::best_of(3, [&]() {
+    for (int i(0); i < count; ++i)
+      f();
+  });
+
+  std::cout << "  " << name << ": " << (t * 1000) << " ms, "
+    << (bench::heap().allocations / (3.0 * count)) << " allocations/document" << std::endl;
+}
+
+template<typename F>
+static void run(const char* name, int n, F&& f)
+{
+  size_t retained = 0;
+  size_t allocations = 0;
+
+  double t = bench::best_of(3, [&]() {
+    const size_t before = bench::heap().current;
+    bench::reset_peak();
+    json::Json value = f();
+    retained = bench::heap().current - before;
+    allocations = bench::heap().allocations;
+  });
+
+  std::cout << "  " << name << ": " << (t * 1000) << " ms, "
+    << bench::mb(retained) << " MB retained (" << (double(retained) / n) << " bytes/value), "
+    << allocations << " allocations" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  const int n = argc > 1 ? std::stoi(argv[1]) : 4000000;
+
+  std::cout << "sizeof(json::Json): " << sizeof(json::Json) << " bytes" << std::endl;
+  std::cout << n << " values:" << std::endl;
+
+  run("build", n, [n]() { return build_scalars(n); });
+
+  json::Array values = build_scalars(n);
+
+  run("copy", n, [&values]() {
+    json::Array copy;
+    copy.data() = values.data();
+    return copy;
+  });
+
+  {
+    double t = bench::best_of(3, [&values]() {
+      volatile bool eq = (values == build_scalars(values.length()));
+      (void)eq;
+    });
+
+    std::cout << "  build + compare: " << (t * 1000) << " ms" << std::endl;
+  }
+
+  run("objects", n, [n]() { return build_objects(n / 8); });
+
+  {
+    json::Array objects = build_objects(n / 8);
+    const std::vector<std::string> keys(std::begin(field_names), std::end(field_names));
+    long long sum = 0;
+
+    double t = bench::best_of(3, [&]() {
+      for (const json::Json& obj : objects.data())
+      {
+        for (const std::string& k : keys)
+          sum += obj[k].toInt();
+      }
+    });
+
+    std::cout << "  lookups: " << (t * 1000) << " ms (" << (sum != 0) << ")" << std::endl;
+
+    t = bench::best_of(3, [&]() {
+      json::JsonView view = objects;
+
+      for (int i(0); i < view.length(); ++i)
+      {
+        for (const std::string& k : keys)
+          sum += view[i][k].toInt();
+      }
+    });
+
+    std::cout << "  lookups (view): " << (t * 1000) << " ms (" << (sum != 0) << ")" << std::endl;
+
+    t = bench::best_of(3, [&]() {
+      volatile bool eq = (json::compare(objects, build_objects(n / 8)) == 0);
+      (void)eq;
+    });
+
+    std::cout << "  build + compare: " << (t * 1000) << " ms" << std::endl;
+  }
+
+  {
+    // payloads with many duplicates, whose fields are not always in the same order
+    std::vector<json::Json> payloads;
+
+    for (int i(0); i < n / 16; ++i)
+    {
+      json::Object obj;
+      obj[(i & 1) ? "id" : "key"] = i % 1000;
+      obj[(i & 1) ? "key" : "id"] = i % 1000;
+      obj["tags"] = json::Array();
+      obj["tags"].push("tag" + std::to_string(i % 7));
+      payloads.push_back(obj);
+    }
+
+    size_t unique = 0;
+
+    double t = bench::best_of(3, [&]() {
+      std::unordered_set<json::Json> set;
+
+      for (const json::Json& p : payloads)
+        set.insert(p);
+
+      unique = set.size();
+    });
+
+    std::cout << "  dedupe: " << (t * 1000) << " ms (" << payloads.size() << " payloads, " << unique << " unique)" << std::endl;
+
+    json::Array lhs = build_objects(n / 8);
+    json::Array rhs = build_objects(n / 8);
+    rhs.data().back()["id"] = -1;
+    json::hash(lhs);
+    json::hash(rhs);
+
+    t = bench::best_of(3, [&]() {
+      for (int i(0); i < 1000; ++i)
+      {
+        volatile bool eq = (lhs == rhs);
+        (void)eq;
+      }
+    });
+
+    std::cout << "  compare x1000 (hashed): " << (t * 1000) << " ms" << std::endl;
+  }
+
+  {
+    json::Json objects = build_objects(n / 8);
+
+    run("deep copy + modify", n, [&objects]() {
+      json::Json copy = deep_copy(objects);
+      copy[0]["id"] = -1;
+      return copy;
+    });
+
+    objects.freeze();
+
+    run("frozen copy + modify", n, [&objects]() {
+      json::Json copy = objects;
+      copy[0]["id"] = -1;
+      return copy;
+    });
+  }
+
+  {
+    // revisions of a large object that change a few keys each
+    const int keys = 100000;
+    const int revisions = 100;
+    json::Object config;
+
+    for (int i(0); i < keys; ++i)
+      config["setting." + std::to_string(i)] = i;
+
+    config.freeze();
+
+    size_t before = bench::heap().current;
+    bench::Timer timer;
+
+    {
+      std::vector<json::Json> versions{ config };
+
+      for (int r(0); r < revisions; ++r)
+      {
+        json::Json next = versions.back();
+        next["setting." + std::to_string((r * 7919) % keys)] = -r;
+        next.freeze();
+        versions.push_back(next);
+      }
+
+      std::cout << "  " << revisions << " revisions of " << keys << " keys: " << (timer.seconds() * 1000) << " ms, "
+        << bench::mb(bench::heap().current - before) << " MB" << std::endl;
+    }
+
+    const json::PersistentObject persistent{ config };
+    before = bench::heap().current;
+    timer = bench::Timer();
+
+    {
+      std::vector<json::PersistentObject> versions{ persistent };
+
+      for (int r(0); r < revisions; ++r)
+        versions.push_back(versions.back().insert("setting." + std::to_string((r * 7919) % keys), -r));
+
+      std::cout << "  " << revisions << " revisions of " << keys << " keys (persistent): " << (timer.seconds() * 1000) << " ms, "
+        << bench::mb(bench::heap().current - before) << " MB" << std::endl;
+    }
+  }
+
+  const std::string input = generate_numbers(n / 2);
+  run("parse", n, [&input]() { return json::parse(input); });
+
+  const std::string series = generate_series(n);
+  run("parse series", n, [&series]() { return json::parse(series); });
+
+  {
+    json::Json value = json::parse(series);
+    double sum = 0;
+
+    double t = bench::best_of(3, [&value, &sum]() {
+      for (int i(0); i < value.length(); ++i)
+        sum += value.at(i).toNumber();
+    });
+
+    std::cout << "  sum series: " << (t * 1000) << " ms (" << (sum != 0) << ")" << std::endl;
+
+    t = bench::best_of(3, [&value, &sum]() {
+      for (double x : json::JsonView(value).numbers())
+        sum += x;
+    });
+
+    std::cout << "  sum series (span): " << (t * 1000) << " ms (" << (sum != 0) << ")" << std::endl;
+
+    size_t count = 0;
+
+    t = bench::best_of(3, [&value, &count]() {
+      count = json::stringify(value).size();
+    });
+
+    std::cout << "  stringify series: " << (t * 1000) << " ms (" << count << " bytes)" << std::endl;
+  }
+
+  const std::string records = generate_records(n / 8);
+  run("parse records", n / 8, [&records]() { return json::parse(records); });
+
+  {
+    // the strings of the table are shared with the parsed records,
+    // which are released before the table is measured
+    const size_t before = bench::heap().current;
+    json::Json value = json::parse(records);
+    bench::Timer timer;
+    json::ColumnarArray table{ value };
+    const double t = timer.seconds();
+    value = nullptr;
+    const size_t retained = bench::heap().current - before;
+    value = table.toJson();
+
+    std::cout << "  columnar records: " << (t * 1000) << " ms, " << bench::mb(retained) << " MB retained ("
+      << (double(retained) / table.length()) << " bytes/value)" << std::endl;
+
+    int max = 0;
+
+    double scan = bench::best_of(3, [&value, &max]() {
+      for (int i(0); i < value.length(); ++i)
+        max = std::max(max, value.at(i)["owner_identifier"].toInt());
+    });
+
+    std::cout << "  scan records: " << (scan * 1000) << " ms (" << max << ")" << std::endl;
+
+    scan = bench::best_of(3, [&table, &max]() {
+      for (int x : table.column("owner_identifier")->integers())
+        max = std::max(max, x);
+    });
+
+    std::cout << "  scan records (columnar): " << (scan * 1000) << " ms (" << max << ")" << std::endl;
+
+    size_t count = 0;
+
+    scan = bench::best_of(3, [&value, &count]() {
+      count = count_scalars(value);
+    });
+
+    std::cout << "  traverse records: " << (scan * 1000) << " ms (" << count << " scalars)" << std::endl;
+
+    scan = bench::best_of(3, [&value, &count]() {
+      count = json::visit(ScalarCounter(), value);
+    });
+
+    std::cout << "  traverse records (visit): " << (scan * 1000) << " ms (" << count << " scalars)" << std::endl;
+
+    scan = bench::best_of(3, [&value, &count]() {
+      count = json::stringify(value).size();
+    });
+
+    std::cout << "  stringify records: " << (scan * 1000) << " ms (" << count << " bytes)" << std::endl;
+
+    scan = bench::best_of(3, [&value, &count]() {
+      count = json::stringify(value, json::Compact).size();
+    });
+
+    std::cout << "  stringify records (compact): " << (scan * 1000) << " ms (" << count << " bytes)" << std::endl;
+
+    bench::reset_peak();
+    size_t base = bench::heap().current;
+    count = json::stringify(value, json::Compact).size();
+    const size_t string_peak = bench::heap().peak - base;
+
+    scan = bench::best_of(3, [&value, &count]() {
+      CountingSink sink;
+      json::stringify_to(sink, value, json::Compact);
+      count = sink.size;
+    });
+
+    bench::reset_peak();
+    base = bench::heap().current;
+    CountingSink sink;
+    json::stringify_to(sink, value, json::Compact);
+
+    std::cout << "  stringify_to records (compact): " << (scan * 1000) << " ms (" << count << " bytes), "
+      << bench::mb(bench::heap().peak - base) << " MB peak (stringify: " << bench::mb(string_peak) << " MB)" << std::endl;
+  }
+
+  {
+    const json::Json logs = json::parse(generate_logs(n / 16));
+    size_t count = 0;
+
+    const double t = bench::best_of(3, [&logs, &count]() {
+      count = json::stringify(logs, json::Compact).size();
+    });
+
+    std::cout << "  stringify logs: " << (t * 1000) << " ms (" << count << " bytes)" << std::endl;
+  }
+
+  const std::string configs = generate_configs(n / 16);
+  run("parse configs", n / 16, [&configs]() { return json::parse(configs); });
+
+  run("parse configs (deduplicated)", n / 16, [&configs]() {
+    json::Deduplicator deduplicator;
+    return json::parse(configs, deduplicator);
+  });
+
+  {
+    json::Json value = json::parse(configs);
+    bench::Timer timer;
+    json::DeduplicationReport report = json::deduplicate(value);
+    std::cout << "  deduplicate: " << (timer.seconds() * 1000) << " ms, " << report.unique << " unique values, "
+      << report.duplicates << " duplicates, " << bench::mb(report.bytes_saved) << " MB saved" << std::endl;
+  }
+
+  const std::string request = generate_request();
+  const int count = 20000;
+  std::cout << count << " documents of " << request.size() << " bytes:" << std::endl;
+
+  run_documents("parse", count, [&request]() {
+    json::Json value = json::parse(request);
+  });
+
+  json::Document doc;
+
+  run_documents("parse (document)", count, [&request, &doc]() {
+    doc.parse(request);
+  });
+}
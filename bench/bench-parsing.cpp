@@ -0,0 +1,168 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "bench.h"
+
+#include "json-toolkit/parsing.h"
+
+#include <iostream>
+
+static std::string generate_document(size_t size)
+{
+  std::string result = "[";
+  int i = 0;
+
+  while (result.size() < size)
+  {
+    if (i > 0)
+      result += ", ";
+
+    result += "{ \"id\": " + std::to_string(i) + ", \"name\": \"record number " + std::to_string(i) + "\", ";
+    result += "\"enabled\": " + std::string(i % 2 ? "true" : "false") + ", \"ratio\": " + std::to_string(i / 7.0) + ", ";
+    result += "\"tags\": [\"alpha\", \"beta\", \"gamma\"], \"parent\": null }";
+    ++i;
+  }
+
+  result += "]";
+  return result;
+}
+
+static std::string generate_numbers(size_t size)
+{
+  std::string result = "[";
+  unsigned state = 1;
+
+  while (result.size() < size)
+  {
+    state = state * 1103515245 + 12345;
+    result += std::to_string(state % 100000) + ", " + std::to_string((state >> 8) / 1000.0) + ", ";
+  }
+
+  result += "0]";
+  return result;
+}
+
+// The parsing strategy used before tokens were directly fed to the parser:
+// the whole input is first tokenized into a vector of tokens.
+static json::Json parse_two_pass(const std::string& str)
+{
+  json::Tokenizer<json::DefaultTokenizerBackend> tokenizer;
+  auto& buffer = tokenizer.backend().token_buffer;
+  tokenizer.write(str);
+  tokenizer.done();
+
+  json::ParserMachine<json::DefaultParserBackend> parser;
+
+  for (const auto& tok : buffer)
+    parser.write(tok);
+
+  return parser.backend().stack.front();
+}
+
+struct CountingTokenizerBackend : public json::BasicTokenizerBackend
+{
+  size_t count = 0;
+
+  void produce(json::TokenType, json::StringView)
+  {
+    ++count;
+  }
+};
+
+template<typename F>
+static void run_tokenizer(const char* name, const std::string& input, F&& write)
+{
+  size_t count = 0;
+
+  double t = bench::best_of(3, [&]() {
+    json::Tokenizer<CountingTokenizerBackend> tokenizer;
+    write(tokenizer, input);
+    tokenizer.done();
+    count = tokenizer.backend().count;
+  });
+
+  std::cout << name << ": " << bench::mb(input.size()) / t << " MB/s, " << count << " tokens" << std::endl;
+}
+
+template<typename F>
+static void run(const char* name, const std::string& input, F&& parse)
+{
+  bench::reset_peak();
+  const size_t baseline = bench::heap().current;
+
+  const int runs = 3;
+
+  double t = bench::best_of(runs, [&]() {
+    json::Json result = parse(input);
+  });
+
+  std::cout << name << ": " << bench::mb(input.size()) / t << " MB/s, "
+    << "peak heap " << bench::mb(bench::heap().peak - baseline) << " MB, "
+    << bench::heap().allocations / runs << " allocations" << std::endl;
+}
+
+static void run_number_conversion(const std::string& input)
+{
+  std::vector<std::string> numbers;
+
+  json::Tokenizer<json::DefaultTokenizerBackend> tokenizer;
+  tokenizer.write(input);
+  tokenizer.done();
+
+  for (const json::Token& tok : tokenizer.backend().token_buffer)
+  {
+    if (tok.type == json::TokenType::Number)
+      numbers.push_back(tok.text);
+  }
+
+  double sum = 0;
+
+  double t = bench::best_of(3, [&]() {
+    for (const std::string& str : numbers)
+      sum += std::stod(str);
+  });
+
+  std::cout << "std::stod: " << numbers.size() / t / 1e6 << " M/s" << std::endl;
+
+  t = bench::best_of(3, [&]() {
+    for (const std::string& str : numbers)
+    {
+      double value;
+      json::read_number(str, &value);
+      sum += value;
+    }
+  });
+
+  std::cout << "json::read_number: " << numbers.size() / t / 1e6 << " M/s" << std::endl;
+  std::cout << "checksum: " << sum << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  size_t size_mb = argc > 1 ? std::stoul(argv[1]) : 16;
+
+  {
+    std::string input = generate_numbers(size_mb * 1024 * 1024);
+    std::cout << "numbers: " << bench::mb(input.size()) << " MB" << std::endl;
+    run_number_conversion(input);
+    run("fused", input, [](const std::string& str) { return json::parse(str); });
+  }
+
+  std::string input = generate_document(size_mb * 1024 * 1024);
+
+  std::cout << "records: " << bench::mb(input.size()) << " MB" << std::endl;
+
+  using Tokenizer = json::Tokenizer<CountingTokenizerBackend>;
+
+  run_tokenizer("tokenizer", input, [](Tokenizer& tokenizer, const std::string& str) {
+    tokenizer.write(str);
+  });
+
+  run_tokenizer("tokenizer (indexed)", input, [](Tokenizer& tokenizer, const std::string& str) {
+    tokenizer.writeIndexed(str);
+  });
+
+  run("two-pass", input, parse_two_pass);
+  run("fused", input, [](const std::string& str) { return json::parse(str); });
+}
@@ -0,0 +1,130 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+// bench.h is not used as its allocation counters are not thread-safe.
+
+#include "json-toolkit/parsing.h"
+#include "json-toolkit/snapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static std::string generate_config(int version)
+{
+  std::string result = "{ \"version\": " + std::to_string(version) + ", \"services\": [";
+
+  for (int i(0); i < 100; ++i)
+  {
+    if (i > 0)
+      result += ", ";
+
+    result += "{ \"name\": \"service-" + std::to_string(i) + "\", \"port\": " + std::to_string(8000 + i) + ", ";
+    result += "\"timeout\": " + std::to_string(version % 30) + ", \"enabled\": true }";
+  }
+
+  result += "] }";
+  return result;
+}
+
+// A Json value protected by a mutex, that readers copy.
+class LockedValue
+{
+public:
+  explicit LockedValue(json::Json value) : m_value(value) { }
+
+  json::Json load() const
+  {
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    return m_value;
+  }
+
+  void publish(json::Json value)
+  {
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    m_value = value;
+  }
+
+private:
+  mutable std::mutex m_mutex;
+  json::Json m_value;
+};
+
+// Runs `threads` readers for `seconds` while the value is reloaded every
+// `reload_us` microseconds, and returns the number of reads per second.
+template<typename Read, typename Publish>
+static double measure(int threads, double seconds, int reload_us, Read&& read, Publish&& publish)
+{
+  std::atomic<bool> done{ false };
+  std::atomic<long long> total{ 0 };
+  std::vector<std::thread> readers;
+
+  for (int i(0); i < threads; ++i)
+  {
+    readers.emplace_back([&]() {
+      long long reads = 0;
+      long long sum = 0;
+
+      while (!done.load(std::memory_order_relaxed))
+      {
+        sum += read();
+        ++reads;
+      }
+
+      total += reads + (sum == -1 ? 1 : 0);
+    });
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  auto elapsed = [start]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+  int version = 1;
+
+  while (elapsed() < seconds)
+  {
+    publish(json::parse(generate_config(version++)));
+    std::this_thread::sleep_for(std::chrono::microseconds(reload_us));
+  }
+
+  done = true;
+
+  for (std::thread& t : readers)
+    t.join();
+
+  return total.load() / elapsed();
+}
+
+int main(int argc, char* argv[])
+{
+  const int threads = argc > 1 ? std::stoi(argv[1]) : std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+  const double seconds = 1.0;
+  const int reload_us = 1000;
+
+  std::cout << threads << " readers, reload every " << reload_us << " us:" << std::endl;
+
+  {
+    LockedValue value{ json::parse(generate_config(0)) };
+
+    double reads = measure(threads, seconds, reload_us, [&value]() {
+      json::Json config = value.load();
+      return json::JsonView(config)["services"][42]["port"].toInt();
+    }, [&value](json::Json v) { value.publish(v); });
+
+    std::cout << "  mutex + copy: " << (reads / 1e6) << " M reads/s" << std::endl;
+  }
+
+  {
+    json::AtomicSnapshot snapshot{ json::parse(generate_config(0)) };
+
+    double reads = measure(threads, seconds, reload_us, [&snapshot]() {
+      json::AtomicSnapshot::Reader reader = snapshot.read();
+      return reader.view()["services"][42]["port"].toInt();
+    }, [&snapshot](json::Json v) { snapshot.publish(v); });
+
+    std::cout << "  AtomicSnapshot: " << (reads / 1e6) << " M reads/s, " << snapshot.pending() << " pending versions" << std::endl;
+  }
+}
@@ -0,0 +1,122 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_BENCH_H
+#define JSONTOOLKIT_BENCH_H
+
+// This header replaces the global operator new/delete in order to measure
+// heap usage; it must be included by exactly one source file per executable.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace bench
+{
+
+struct HeapCounters
+{
+  size_t current = 0;
+  size_t peak = 0;
+  size_t allocations = 0;
+};
+
+inline HeapCounters& heap()
+{
+  static HeapCounters counters;
+  return counters;
+}
+
+inline void reset_peak()
+{
+  heap().peak = heap().current;
+  heap().allocations = 0;
+}
+
+inline double mb(size_t bytes)
+{
+  return bytes / (1024.0 * 1024.0);
+}
+
+class Timer
+{
+public:
+  Timer() : m_start(std::chrono::steady_clock::now()) { }
+
+  double seconds() const
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point m_start;
+};
+
+// Runs `f` `n` times and returns the best time in seconds.
+template<typename F>
+double best_of(int n, F&& f)
+{
+  double best = 1e30;
+
+  for (int i(0); i < n; ++i)
+  {
+    Timer timer;
+    f();
+    const double t = timer.seconds();
+    best = t < best ? t : best;
+  }
+
+  return best;
+}
+
+} // namespace bench
+
+namespace bench
+{
+
+namespace details
+{
+
+// Every block is prefixed with its size so that the counters can be 
+// updated on deallocation.
+static const size_t header_size = 16;
+
+inline void* allocate(size_t size)
+{
+  void* ptr = std::malloc(size + header_size);
+
+  if (!ptr)
+    throw std::bad_alloc();
+
+  *static_cast<size_t*>(ptr) = size;
+  heap().current += size;
+  heap().allocations += 1;
+  heap().peak = heap().current > heap().peak ? heap().current : heap().peak;
+  return static_cast<char*>(ptr) + header_size;
+}
+
+inline void deallocate(void* ptr)
+{
+  if (!ptr)
+    return;
+
+  void* block = static_cast<char*>(ptr) - header_size;
+  heap().current -= *static_cast<size_t*>(block);
+  std::free(block);
+}
+
+} // namespace details
+
+} // namespace bench
+
+void* operator new(size_t size) { return bench::details::allocate(size); }
+void* operator new[](size_t size) { return bench::details::allocate(size); }
+void operator delete(void* ptr) noexcept { bench::details::deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { bench::details::deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { bench::details::deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { bench::details::deallocate(ptr); }
+
+#endif // !JSONTOOLKIT_BENCH_H
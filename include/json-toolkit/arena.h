@@ -0,0 +1,221 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_ARENA_H
+#define JSONTOOLKIT_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace json
+{
+
+/*
+ * A monotonic allocator.
+ *
+ * Memory is carved out of large chunks and is only given back when
+ * the arena is reset or destroyed, so that freeing many small objects
+ * costs a handful of deallocations.
+ */
+class Arena
+{
+public:
+  static const size_t default_chunk_size = 64 * 1024;
+
+  explicit Arena(size_t chunk_size = default_chunk_size)
+    : m_chunks(nullptr),
+      m_cursor(nullptr),
+      m_end(nullptr),
+      m_chunk_size(chunk_size)
+  {
+
+  }
+
+  Arena(const Arena&) = delete;
+
+  ~Arena()
+  {
+    release(nullptr);
+  }
+
+  void* allocate(size_t size, size_t align)
+  {
+    char* ptr = aligned(m_cursor, align);
+
+    if (m_cursor == nullptr || ptr > m_end || size > static_cast<size_t>(m_end - ptr))
+      return grow(size, align);
+
+    m_cursor = ptr + size;
+    return ptr;
+  }
+
+  inline size_t chunkSize() const { return m_chunk_size; }
+
+  // Returns the number of bytes obtained from the global heap.
+  size_t capacity() const
+  {
+    size_t result = 0;
+
+    for (Chunk* c = m_chunks; c != nullptr; c = c->next)
+      result += c->size;
+
+    return result;
+  }
+
+  // Invalidates all the memory allocated by the arena.
+  // A chunk is kept so that the arena can be reused without going
+  // through the global heap again.
+  void reset()
+  {
+    Chunk* kept = nullptr;
+
+    for (Chunk* c = m_chunks; c != nullptr; c = c->next)
+    {
+      if (c->size == m_chunk_size)
+        kept = c;
+    }
+
+    release(kept);
+
+    m_chunks = kept;
+
+    if (kept)
+    {
+      kept->next = nullptr;
+      m_cursor = reinterpret_cast<char*>(kept) + sizeof(Chunk);
+      m_end = reinterpret_cast<char*>(kept) + kept->size;
+    }
+    else
+    {
+      m_cursor = nullptr;
+      m_end = nullptr;
+    }
+  }
+
+  // Exchanges the memory of the two arenas.
+  void swap(Arena& other)
+  {
+    std::swap(m_chunks, other.m_chunks);
+    std::swap(m_cursor, other.m_cursor);
+    std::swap(m_end, other.m_end);
+    std::swap(m_chunk_size, other.m_chunk_size);
+  }
+
+  Arena& operator=(const Arena&) = delete;
+
+protected:
+  struct Chunk
+  {
+    Chunk* next;
+    size_t size;
+  };
+
+  static char* aligned(char* ptr, size_t align)
+  {
+    const uintptr_t p = reinterpret_cast<uintptr_t>(ptr);
+    return reinterpret_cast<char*>((p + align - 1) & ~(uintptr_t(align) - 1));
+  }
+
+  char* grow(size_t size, size_t align)
+  {
+    const size_t header = sizeof(Chunk);
+    const size_t needed = header + size + align;
+
+    if (needed > m_chunk_size / 2 && m_chunks != nullptr)
+    {
+      // large blocks get their own chunk, the current chunk is kept
+      Chunk* c = static_cast<Chunk*>(::operator new(needed));
+      c->size = needed;
+      c->next = m_chunks->next;
+      m_chunks->next = c;
+      return aligned(reinterpret_cast<char*>(c) + header, align);
+    }
+
+    const size_t chunk_size = needed > m_chunk_size ? needed : m_chunk_size;
+    Chunk* c = static_cast<Chunk*>(::operator new(chunk_size));
+    c->size = chunk_size;
+    c->next = m_chunks;
+    m_chunks = c;
+    m_end = reinterpret_cast<char*>(c) + chunk_size;
+
+    char* ptr = aligned(reinterpret_cast<char*>(c) + header, align);
+    m_cursor = ptr + size;
+    return ptr;
+  }
+
+  void release(Chunk* kept)
+  {
+    Chunk* c = m_chunks;
+
+    while (c != nullptr)
+    {
+      Chunk* next = c->next;
+
+      if (c != kept)
+        ::operator delete(c);
+
+      c = next;
+    }
+  }
+
+private:
+  Chunk* m_chunks;
+  char* m_cursor;
+  char* m_end;
+  size_t m_chunk_size;
+};
+
+/*
+ * Standard allocator that takes its memory from an Arena, or from the
+ * global heap if no arena is provided.
+ */
+template<typename T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+
+  ArenaAllocator() : m_arena(nullptr) { }
+  ArenaAllocator(Arena* arena) : m_arena(arena) { }
+
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.arena()) { }
+
+  inline Arena* arena() const { return m_arena; }
+
+  T* allocate(size_t n)
+  {
+    if (m_arena)
+      return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    else
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, size_t)
+  {
+    if (!m_arena)
+      ::operator delete(ptr);
+  }
+
+private:
+  Arena* m_arena;
+};
+
+template<typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs)
+{
+  return lhs.arena() == rhs.arena();
+}
+
+template<typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs)
+{
+  return lhs.arena() != rhs.arena();
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_ARENA_H
@@ -0,0 +1,326 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_COLUMNAR_H
+#define JSONTOOLKIT_COLUMNAR_H
+
+#include "json-toolkit/json.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace json
+{
+
+enum class ColumnType
+{
+  Integer,
+  Number,
+  String,
+  // Values of different types, or booleans, nulls, arrays and objects.
+  Mixed,
+};
+
+/*
+ * The values of a field of a ColumnarArray, one per row.
+ *
+ * Integer and number columns store their values contiguously; string
+ * columns store the index of each value in a dictionary of distinct
+ * strings; the other columns store Json values.
+ */
+class Column
+{
+public:
+  explicit Column(ColumnType type = ColumnType::Mixed) : m_type(type) { }
+
+  inline ColumnType type() const { return m_type; }
+  size_t size() const;
+
+  // Returns the values of an integer column, an empty span otherwise.
+  Span<const int> integers() const { return Span<const int>(m_integers.data(), m_integers.size()); }
+
+  // Returns the values of a number column, an empty span otherwise.
+  Span<const double> numbers() const { return Span<const double>(m_numbers.data(), m_numbers.size()); }
+
+  // Returns, for a string column, the position of the value of each
+  // row in dictionary().
+  Span<const uint32_t> indices() const { return Span<const uint32_t>(m_indices.data(), m_indices.size()); }
+  inline const std::vector<Json>& dictionary() const { return m_values; }
+
+  // Returns the values of a mixed column.
+  Span<const Json> values() const;
+
+  Json at(size_t row) const;
+
+protected:
+  friend class ColumnarArray;
+
+  void append(const Json& value, std::unordered_map<Json, uint32_t>& strings);
+
+private:
+  ColumnType m_type;
+  std::vector<int> m_integers;
+  std::vector<double> m_numbers;
+  std::vector<uint32_t> m_indices;
+  // Distinct strings of a string column, values of a mixed column.
+  std::vector<Json> m_values;
+};
+
+/*
+ * An immutable array of objects that have the same fields, stored as
+ * one Column per field rather than one object per element.
+ *
+ * Rows are read as objects, through Row; scans and aggregates can read
+ * the columns directly.
+ * Arrays and objects nested in the rows are frozen (see Json::freeze())
+ * as they are shared with the array the columns were built from.
+ */
+class ColumnarArray
+{
+public:
+  typedef FlatMap<Column> Columns;
+
+  /*
+   * An element of a ColumnarArray, which must outlive the row.
+   */
+  class Row
+  {
+  public:
+    Row(const ColumnarArray& array, size_t index) : m_array(&array), m_index(index) { }
+
+    inline size_t index() const { return m_index; }
+
+    // Returns a null value if there is no field named `key`.
+    Json operator[](StringView key) const
+    {
+      const Column* column = m_array->column(key);
+      return column ? column->at(m_index) : Json(nullptr);
+    }
+
+    inline bool contains(StringView key) const { return m_array->column(key) != nullptr; }
+
+    // Calls `f(const Key&, const Json&)` for each field.
+    template<typename F>
+    void forEach(F&& f) const
+    {
+      for (const auto& c : m_array->columns())
+        f(c.first, c.second.at(m_index));
+    }
+
+    Json toJson() const
+    {
+      Object result;
+      result.data().reserve(m_array->columns().size());
+
+      forEach([&result](const Key& key, const Json& value) {
+        result.data().emplace(key, value);
+      });
+
+      return result;
+    }
+
+  private:
+    const ColumnarArray* m_array;
+    size_t m_index;
+  };
+
+  ColumnarArray() : m_length(0) { }
+
+  // Creates an array with the elements of `array`, which is left empty
+  // if convertible() returns false.
+  explicit ColumnarArray(const Json& array);
+
+  // Returns whether `array` is an array of objects that have the same
+  // fields, in the same order.
+  static bool convertible(const Json& array);
+
+  inline int length() const { return static_cast<int>(m_length); }
+  inline bool empty() const { return m_length == 0; }
+
+  inline Row at(int index) const { return Row(*this, static_cast<size_t>(index)); }
+  inline Row operator[](int index) const { return at(index); }
+
+  inline const Columns& columns() const { return m_columns; }
+
+  // Returns nullptr if there is no field named `key`.
+  const Column* column(StringView key) const
+  {
+    auto it = m_columns.find(key);
+    return it != m_columns.end() ? &(it->second) : nullptr;
+  }
+
+  Json toJson() const
+  {
+    Array result;
+    result.data().reserve(m_length);
+
+    for (size_t i(0); i < m_length; ++i)
+      result.data().push_back(Row(*this, i).toJson());
+
+    return result;
+  }
+
+private:
+  size_t m_length;
+  Columns m_columns;
+};
+
+namespace details
+{
+
+inline ColumnType column_type(JsonView array, size_t field)
+{
+  const JsonType type = array.at(0).fields().begin()[field].second.type();
+
+  if (type != JsonType::Integer && type != JsonType::Number && type != JsonType::String)
+    return ColumnType::Mixed;
+
+  for (int i(1); i < array.length(); ++i)
+  {
+    if (array.at(i).fields().begin()[field].second.type() != type)
+      return ColumnType::Mixed;
+  }
+
+  return type == JsonType::Integer ? ColumnType::Integer : (type == JsonType::Number ? ColumnType::Number : ColumnType::String);
+}
+
+} // namespace details
+
+inline size_t Column::size() const
+{
+  switch (m_type)
+  {
+  case ColumnType::Integer:
+    return m_integers.size();
+  case ColumnType::Number:
+    return m_numbers.size();
+  case ColumnType::String:
+    return m_indices.size();
+  default:
+    return m_values.size();
+  }
+}
+
+inline Span<const Json> Column::values() const
+{
+  if (m_type != ColumnType::Mixed)
+    return Span<const Json>();
+
+  return Span<const Json>(m_values.data(), m_values.size());
+}
+
+inline Json Column::at(size_t row) const
+{
+  switch (m_type)
+  {
+  case ColumnType::Integer:
+    return m_integers.at(row);
+  case ColumnType::Number:
+    return m_numbers.at(row);
+  case ColumnType::String:
+    return m_values[m_indices.at(row)];
+  default:
+    return m_values.at(row);
+  }
+}
+
+inline void Column::append(const Json& value, std::unordered_map<Json, uint32_t>& strings)
+{
+  switch (m_type)
+  {
+  case ColumnType::Integer:
+    m_integers.push_back(value.toInt());
+    break;
+  case ColumnType::Number:
+    m_numbers.push_back(value.toNumber());
+    break;
+  case ColumnType::String:
+  {
+    auto it = strings.emplace(value, static_cast<uint32_t>(m_values.size()));
+
+    if (it.second)
+      m_values.push_back(value);
+
+    m_indices.push_back(it.first->second);
+    break;
+  }
+  default:
+  {
+    Json copy = value;
+    copy.freeze();
+    m_values.push_back(copy);
+    break;
+  }
+  }
+}
+
+inline ColumnarArray::ColumnarArray(const Json& array)
+  : m_length(0)
+{
+  if (!convertible(array))
+    return;
+
+  JsonView rows = array;
+  m_length = static_cast<size_t>(rows.length());
+
+  if (m_length == 0)
+    return;
+
+  const ObjectStorage& first = rows.at(0).fields();
+  m_columns.reserve(first.size());
+
+  for (size_t j(0); j < first.size(); ++j)
+  {
+    Column& column = m_columns.emplace(first.begin()[j].first, details::column_type(rows, j)).first->second;
+    std::unordered_map<Json, uint32_t> strings;
+
+    for (size_t i(0); i < m_length; ++i)
+      column.append(rows.at(static_cast<int>(i)).fields().begin()[j].second, strings);
+
+    column.m_integers.shrink_to_fit();
+    column.m_numbers.shrink_to_fit();
+    column.m_indices.shrink_to_fit();
+    column.m_values.shrink_to_fit();
+  }
+}
+
+inline bool ColumnarArray::convertible(const Json& array)
+{
+  if (!array.isArray())
+    return false;
+
+  JsonView rows = array;
+
+  if (rows.length() == 0)
+    return true;
+
+  if (!rows.at(0).isObject())
+    return false;
+
+  const ObjectStorage& first = rows.at(0).fields();
+
+  for (int i(1); i < rows.length(); ++i)
+  {
+    if (!rows.at(i).isObject())
+      return false;
+
+    const ObjectStorage& fields = rows.at(i).fields();
+
+    if (fields.size() != first.size())
+      return false;
+
+    for (size_t j(0); j < first.size(); ++j)
+    {
+      if (fields.begin()[j].first != first.begin()[j].first)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_COLUMNAR_H
@@ -0,0 +1,317 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_DEDUPLICATION_H
+#define JSONTOOLKIT_DEDUPLICATION_H
+
+#include "json-toolkit/document.h"
+#include "json-toolkit/json.h"
+#include "json-toolkit/parsing.h"
+
+#include <unordered_set>
+
+namespace json
+{
+
+struct DeduplicationReport
+{
+  // Number of distinct strings, arrays and objects.
+  size_t unique = 0;
+  // Number of values that were replaced by an equal value.
+  size_t duplicates = 0;
+  // Number of bytes given back to the global heap (or to the arena
+  // for documents) once the duplicates are released.
+  size_t bytes_saved = 0;
+};
+
+namespace details
+{
+
+// Returns the number of bytes that are freed when the last reference
+// to `value` is released; the memory of arena-allocated values is
+// not accounted for.
+inline size_t released_bytes(const Json& value)
+{
+  const Node* node = value.impl();
+
+  if (node == nullptr || node->arena != nullptr || node->ref_count.load(std::memory_order_relaxed) != 1)
+    return 0;
+
+  switch (value.type())
+  {
+  case JsonType::String:
+  {
+    const std::string& str = static_cast<const StringNode*>(node)->value;
+    return sizeof(StringNode) + (str.capacity() > 15 ? str.capacity() + 1 : 0);
+  }
+  case JsonType::Array:
+  {
+    const auto* array = static_cast<const ArrayNode*>(node);
+    const ArrayStorage& elements = array->value;
+    size_t result = sizeof(ArrayNode) + elements.capacity() * sizeof(Json);
+    result += array->packed.capacity() * array->packed.elementSize();
+
+    for (const Json& e : elements)
+      result += released_bytes(e);
+
+    return result;
+  }
+  case JsonType::Object:
+  {
+    const ObjectStorage& fields = static_cast<const ObjectNode*>(node)->value;
+    size_t result = sizeof(ObjectNode) + fields.size() * sizeof(ObjectStorage::value_type);
+
+    for (const auto& f : fields)
+      result += released_bytes(f.second);
+
+    return result;
+  }
+  default:
+    return 0;
+  }
+}
+
+} // namespace details
+
+/*
+ * Replaces structurally equal strings, arrays and objects by a single
+ * shared value (hash-consing).
+ *
+ * Values that went through a Deduplicator share their nodes and are
+ * therefore frozen: modifying one of them copies the modified path
+ * instead of modifying all the places where it is used (see freeze()).
+ * The Deduplicator keeps a reference to each distinct value until it is
+ * cleared or destroyed.
+ */
+class Deduplicator
+{
+public:
+  // If `arena` is not null, the distinct values are copied into it;
+  // otherwise the values are deduplicated in place.
+  explicit Deduplicator(Arena* arena = nullptr)
+    : m_arena(arena)
+  {
+
+  }
+
+  // Returns the value equal to `value` that was first seen by the
+  // deduplicator.
+  // The children are interned first, bottom-up, so that their hash is
+  // cached (they are frozen) when the hash of `value` is computed.
+  Json intern(const Json& value)
+  {
+    if (value.type() < JsonType::String)
+      return value;
+
+    Json result = value;
+
+    if (!value.isString() && !value.isFrozen())
+    {
+      if (m_arena && value.impl()->arena != m_arena)
+        result = copy(value, nullptr);
+      else
+        internChildren(result);
+    }
+
+    result.freeze();
+
+    auto it = m_values.find(result);
+
+    if (it != m_values.end())
+    {
+      if (it->impl() != value.impl())
+      {
+        result = nullptr;
+        m_report.duplicates += 1;
+        m_report.bytes_saved += details::released_bytes(value);
+      }
+
+      return *it;
+    }
+
+    if (m_arena && result.impl()->arena != m_arena)
+    {
+      result = copy(result, m_arena);
+      result.freeze();
+    }
+
+    m_values.insert(result);
+    return result;
+  }
+
+  DeduplicationReport report() const
+  {
+    DeduplicationReport result = m_report;
+    result.unique = m_values.size();
+    return result;
+  }
+
+  void clear()
+  {
+    m_values.clear();
+    m_report = DeduplicationReport();
+  }
+
+protected:
+  // Replaces the children of `value` by their interned value.
+  // The children are replaced by equal values, so the storage is
+  // modified directly.
+  // Frozen values are left untouched.
+  void internChildren(const Json& value)
+  {
+    if (value.isFrozen())
+      return;
+
+    if (value.isArray())
+    {
+      for (Json& e : static_cast<details::ArrayNode*>(value.impl())->value)
+        e = intern(e);
+    }
+    else if (value.isObject())
+    {
+      for (auto& f : static_cast<details::ObjectNode*>(value.impl())->value)
+        f.second = intern(f.second);
+    }
+  }
+
+  // Returns a copy of `value` allocated in `arena` (or on the heap if it
+  // is null), whose children are interned.
+  Json copy(const Json& value, Arena* arena)
+  {
+    if (value.isString())
+    {
+      return arena ? Json(value.toString(), *arena) : Json(value.toString());
+    }
+    else if (value.isArray())
+    {
+      const auto* array = static_cast<const details::ArrayNode*>(value.impl());
+
+      if (array->isPacked())
+      {
+        auto* copy = details::create_node<details::ArrayNode>(arena);
+        copy->packed.assign(arena, array->packed);
+        return Json(JsonType::Array, copy);
+      }
+
+      Array result = arena ? Array(*arena) : Array();
+      const ArrayStorage& elements = array->value;
+      result.data().reserve(elements.size());
+
+      for (const Json& e : elements)
+        result.push(intern(e));
+
+      return result;
+    }
+    else
+    {
+      Object result = arena ? Object(*arena) : Object();
+      const ObjectStorage& fields = JsonView(value).fields();
+      result.data().reserve(fields.size());
+
+      for (const auto& f : fields)
+        result.insert(f.first, intern(f.second));
+
+      return result;
+    }
+  }
+
+private:
+  Arena* m_arena;
+  std::unordered_set<Json> m_values;
+  DeduplicationReport m_report;
+};
+
+// Shares the structurally equal subtrees of `value`, which is frozen.
+inline DeduplicationReport deduplicate(Json& value)
+{
+  Deduplicator deduplicator;
+  value = deduplicator.intern(value);
+  return deduplicator.report();
+}
+
+// Rebuilds the tree of the document with its structurally equal subtrees
+// shared, in a new arena; values previously taken from the document
+// are invalidated.
+inline DeduplicationReport deduplicate(Document& doc)
+{
+  Arena arena{ doc.arena().chunkSize() };
+  DeduplicationReport report;
+
+  {
+    Deduplicator deduplicator{ &arena };
+    Json root = deduplicator.intern(doc.root());
+    report = deduplicator.report();
+    doc.root() = std::move(root);
+  }
+
+  const size_t before = doc.arena().capacity();
+  doc.arena().swap(arena);
+  const size_t after = doc.arena().capacity();
+  report.bytes_saved = before > after ? before - after : 0;
+
+  return report;
+}
+
+/*
+ * Parser backend that deduplicates the strings, arrays and objects
+ * as soon as they are complete.
+ */
+struct DeduplicatingParserBackend : public DefaultParserBackend
+{
+  using DefaultParserBackend::value;
+
+  void value(const std::string& str)
+  {
+    writeValue(deduplicator->intern(make_string(str)));
+  }
+
+  void value(std::string&& str)
+  {
+    writeValue(deduplicator->intern(make_string(std::move(str))));
+  }
+
+  void end_object()
+  {
+    end_container();
+  }
+
+  void end_array()
+  {
+    end_container();
+  }
+
+  void end_container()
+  {
+    if (stack.size() == 1)
+    {
+      stack.front() = deduplicator->intern(stack.front());
+      return;
+    }
+
+    json::Json container = deduplicator->intern(stack.back());
+    stack.pop_back();
+
+    writeValue(std::move(container));
+  }
+
+  Deduplicator* deduplicator = nullptr;
+};
+
+// Parses `str`, sharing the structurally equal subtrees of the document,
+// and of the documents previously parsed with the same deduplicator.
+inline json::Json parse(const std::string& str, Deduplicator& deduplicator)
+{
+  KeyPool pool;
+  Tokenizer<ParsingTokenizerBackend<DeduplicatingParserBackend>> tokenizer;
+  tokenizer.backend().parser.backend().pool = &pool;
+  tokenizer.backend().parser.backend().deduplicator = &deduplicator;
+  tokenizer.writeIndexed(str);
+  tokenizer.done();
+
+  return std::move(tokenizer.backend().parser.backend().stack.front());
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_DEDUPLICATION_H
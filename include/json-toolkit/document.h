@@ -0,0 +1,68 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_DOCUMENT_H
+#define JSONTOOLKIT_DOCUMENT_H
+
+#include "json-toolkit/arena.h"
+#include "json-toolkit/parsing.h"
+
+namespace json
+{
+
+/*
+ * A parsed Json tree whose values are allocated in an arena owned
+ * by the document.
+ *
+ * Destroying or re-parsing the document releases the memory of the
+ * whole tree at once; values taken from the document must therefore
+ * not outlive it.
+ */
+class Document
+{
+public:
+  explicit Document(size_t chunk_size = Arena::default_chunk_size)
+    : m_arena(chunk_size),
+      m_root(nullptr)
+  {
+
+  }
+
+  Document(const Document&) = delete;
+
+  ~Document()
+  {
+    // the nodes must be destroyed before the arena
+    m_root = nullptr;
+  }
+
+  inline Json& root() { return m_root; }
+  inline const Json& root() const { return m_root; }
+
+  inline Arena& arena() { return m_arena; }
+
+  // Returns the pool used to intern the keys of the document; 
+  // it is kept when the document is re-parsed.
+  inline KeyPool& keys() { return m_keys; }
+
+  // Replaces the content of the document, the memory used by the previous
+  // tree is reused.
+  void parse(const std::string& str)
+  {
+    m_root = nullptr;
+    m_arena.reset();
+    m_root = json::parse(str, m_arena, &m_keys);
+  }
+
+  Document& operator=(const Document&) = delete;
+
+private:
+  Arena m_arena;
+  KeyPool m_keys;
+  Json m_root;
+};
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_DOCUMENT_H
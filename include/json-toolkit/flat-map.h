@@ -0,0 +1,259 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_FLAT_MAP_H
+#define JSONTOOLKIT_FLAT_MAP_H
+
+#include "json-toolkit/key.h"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace json
+{
+
+/*
+ * An associative container with Key keys that stores its elements
+ * contiguously, in insertion order.
+ *
+ * Lookups are done by a linear scan of the keys for small maps; past
+ * `index_threshold` elements, a hash table of the element positions
+ * is maintained.
+ * Keys must not be modified through iterators.
+ */
+template<typename T, typename Allocator = std::allocator<std::pair<Key, T>>>
+class FlatMap
+{
+public:
+  typedef Key key_type;
+  typedef T mapped_type;
+  typedef std::pair<Key, T> value_type;
+  typedef typename std::allocator_traits<Allocator>::template rebind_alloc<value_type> allocator_type;
+  typedef std::vector<value_type, allocator_type> container_type;
+  typedef typename container_type::iterator iterator;
+  typedef typename container_type::const_iterator const_iterator;
+  typedef typename container_type::size_type size_type;
+
+  static const size_t index_threshold = 16;
+
+  FlatMap() = default;
+  FlatMap(const FlatMap&) = default;
+  FlatMap(FlatMap&&) = default;
+  ~FlatMap() = default;
+
+  explicit FlatMap(const allocator_type& alloc)
+    : m_entries(alloc),
+      m_index(IndexAllocator(alloc))
+  {
+
+  }
+
+  inline allocator_type get_allocator() const { return m_entries.get_allocator(); }
+
+  inline iterator begin() { return m_entries.begin(); }
+  inline const_iterator begin() const { return m_entries.begin(); }
+  inline const_iterator cbegin() const { return m_entries.cbegin(); }
+  inline iterator end() { return m_entries.end(); }
+  inline const_iterator end() const { return m_entries.end(); }
+  inline const_iterator cend() const { return m_entries.cend(); }
+
+  inline size_type size() const { return m_entries.size(); }
+  inline bool empty() const { return m_entries.empty(); }
+
+  void reserve(size_type n)
+  {
+    m_entries.reserve(n);
+  }
+
+  void clear()
+  {
+    m_entries.clear();
+    m_index.clear();
+  }
+
+  // Replaces the content of the map by the elements in [first, last),
+  // whose keys must be unique.
+  template<typename InputIt>
+  void assign(InputIt first, InputIt last)
+  {
+    m_entries.assign(first, last);
+    rebuildIndex();
+  }
+
+  iterator find(StringView key)
+  {
+    return m_entries.begin() + lookup(key);
+  }
+
+  const_iterator find(StringView key) const
+  {
+    return m_entries.begin() + lookup(key);
+  }
+
+  inline size_type count(StringView key) const
+  {
+    return lookup(key) != m_entries.size() ? 1 : 0;
+  }
+
+  T& at(StringView key)
+  {
+    const size_t pos = lookup(key);
+
+    if (pos == m_entries.size())
+      throw std::out_of_range{ "FlatMap::at()" };
+
+    return m_entries[pos].second;
+  }
+
+  const T& at(StringView key) const
+  {
+    const size_t pos = lookup(key);
+
+    if (pos == m_entries.size())
+      throw std::out_of_range{ "FlatMap::at()" };
+
+    return m_entries[pos].second;
+  }
+
+  T& operator[](StringView key)
+  {
+    return emplace(key).first->second;
+  }
+
+  template<typename K, typename...Args>
+  std::pair<iterator, bool> emplace(K&& key, Args&&... args)
+  {
+    const size_t pos = lookup(key);
+
+    if (pos != m_entries.size())
+      return std::make_pair(m_entries.begin() + pos, false);
+
+    m_entries.emplace_back(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+    indexBack();
+    return std::make_pair(m_entries.end() - 1, true);
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value)
+  {
+    return emplace(value.first, value.second);
+  }
+
+  iterator erase(const_iterator pos)
+  {
+    const auto offset = pos - m_entries.cbegin();
+    m_entries.erase(m_entries.begin() + offset);
+    rebuildIndex();
+    return m_entries.begin() + offset;
+  }
+
+  size_type erase(StringView key)
+  {
+    const size_t pos = lookup(key);
+
+    if (pos == m_entries.size())
+      return 0;
+
+    erase(m_entries.cbegin() + pos);
+    return 1;
+  }
+
+  FlatMap& operator=(const FlatMap&) = default;
+  FlatMap& operator=(FlatMap&&) = default;
+
+protected:
+  typedef typename std::allocator_traits<Allocator>::template rebind_alloc<uint32_t> IndexAllocator;
+
+  static const uint32_t empty_slot = static_cast<uint32_t>(-1);
+
+  static bool key_equals(const Key& k, StringView key)
+  {
+    return k.size() == key.size() && std::memcmp(k.data(), key.data(), key.size()) == 0;
+  }
+
+  // Returns the position of `key`, or size() if it is not in the map.
+  size_t lookup(StringView key) const
+  {
+    if (m_index.empty())
+    {
+      for (size_t i(0); i < m_entries.size(); ++i)
+      {
+        if (key_equals(m_entries[i].first, key))
+          return i;
+      }
+
+      return m_entries.size();
+    }
+
+    const size_t mask = m_index.size() - 1;
+
+    for (size_t slot = details::hash_bytes(key.data(), key.size()) & mask; m_index[slot] != empty_slot; slot = (slot + 1) & mask)
+    {
+      if (key_equals(m_entries[m_index[slot]].first, key))
+        return m_index[slot];
+    }
+
+    return m_entries.size();
+  }
+
+  void insertInIndex(uint32_t pos)
+  {
+    const size_t mask = m_index.size() - 1;
+    const Key& key = m_entries[pos].first;
+    size_t slot = details::hash_bytes(key.data(), key.size()) & mask;
+
+    while (m_index[slot] != empty_slot)
+      slot = (slot + 1) & mask;
+
+    m_index[slot] = pos;
+  }
+
+  void indexBack()
+  {
+    if (m_entries.size() <= index_threshold)
+      return;
+
+    // the load factor is kept under 1/2
+    if (2 * m_entries.size() > m_index.size())
+      rebuildIndex();
+    else
+      insertInIndex(static_cast<uint32_t>(m_entries.size() - 1));
+  }
+
+  void rebuildIndex()
+  {
+    m_index.clear();
+
+    if (m_entries.size() <= index_threshold)
+      return;
+
+    size_t capacity = 4 * index_threshold;
+
+    while (capacity < 4 * m_entries.size())
+      capacity *= 2;
+
+    m_index.assign(capacity, empty_slot);
+
+    for (size_t i(0); i < m_entries.size(); ++i)
+      insertInIndex(static_cast<uint32_t>(i));
+  }
+
+private:
+  container_type m_entries;
+  std::vector<uint32_t, IndexAllocator> m_index;
+};
+
+template<typename T, typename Allocator>
+const size_t FlatMap<T, Allocator>::index_threshold;
+
+template<typename T, typename Allocator>
+const uint32_t FlatMap<T, Allocator>::empty_slot;
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_FLAT_MAP_H
@@ -3,51 +3,201 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include "json-global-defs.h"
+#include "numbers.h"
+#include "simd.h"
 
-#include <sstream>
+#include <string>
 
 namespace json
 {
 
-struct DefaultWriterBackend
+namespace details
 {
-  std::stringstream result_;
 
-  std::string result() { return result_.str(); }
+// Decodes the UTF-8 sequence that starts at `it` and returns its end;
+// an invalid sequence is decoded as U+FFFD, one byte at a time.
+inline const char* decode_utf8(const char* it, const char* end, uint32_t* code_point)
+{
+  const unsigned char lead = static_cast<unsigned char>(*it);
+  int length = 0;
+  uint32_t min = 0;
+
+  if (lead >= 0xC2 && lead <= 0xDF)
+  {
+    length = 1;
+    min = 0x80;
+    *code_point = lead & 0x1F;
+  }
+  else if (lead >= 0xE0 && lead <= 0xEF)
+  {
+    length = 2;
+    min = 0x800;
+    *code_point = lead & 0x0F;
+  }
+  else if (lead >= 0xF0 && lead <= 0xF4)
+  {
+    length = 3;
+    min = 0x10000;
+    *code_point = lead & 0x07;
+  }
+
+  if (length == 0 || end - it <= length)
+  {
+    *code_point = 0xFFFD;
+    return it + 1;
+  }
+
+  for (int i(1); i <= length; ++i)
+  {
+    const unsigned char c = static_cast<unsigned char>(it[i]);
+
+    if ((c & 0xC0) != 0x80)
+    {
+      *code_point = 0xFFFD;
+      return it + 1;
+    }
+
+    *code_point = (*code_point << 6) | (c & 0x3F);
+  }
+
+  if (*code_point < min || *code_point > 0x10FFFF || (*code_point >= 0xD800 && *code_point <= 0xDFFF))
+  {
+    *code_point = 0xFFFD;
+    return it + 1;
+  }
+
+  return it + length + 1;
+}
+
+inline void append_code_unit(std::string& out, uint32_t unit)
+{
+  static const char hex[] = "0123456789abcdef";
+  const char escape[] = { '\\', 'u', hex[(unit >> 12) & 0xF], hex[(unit >> 8) & 0xF], hex[(unit >> 4) & 0xF], hex[unit & 0xF] };
+  out.append(escape, sizeof(escape));
+}
+
+// Appends the escape sequence of the character that starts at `it` 
+// and returns the end of the character.
+inline const char* append_escape(std::string& out, const char* it, const char* end)
+{
+  const char* escaped;
+
+  switch (*it)
+  {
+  case '"': escaped = "\\\""; break;
+  case '\\': escaped = "\\\\"; break;
+  case '\b': escaped = "\\b"; break;
+  case '\f': escaped = "\\f"; break;
+  case '\n': escaped = "\\n"; break;
+  case '\r': escaped = "\\r"; break;
+  case '\t': escaped = "\\t"; break;
+  default:
+  {
+    if (static_cast<unsigned char>(*it) < 0x80)
+    {
+      append_code_unit(out, static_cast<unsigned char>(*it));
+      return it + 1;
+    }
+
+    uint32_t code_point;
+    const char* next = decode_utf8(it, end, &code_point);
+
+    if (code_point >= 0x10000)
+    {
+      code_point -= 0x10000;
+      append_code_unit(out, 0xD800 + (code_point >> 10));
+      append_code_unit(out, 0xDC00 + (code_point & 0x3FF));
+    }
+    else
+    {
+      append_code_unit(out, code_point);
+    }
+
+    return next;
+  }
+  }
+
+  out.append(escaped, 2);
+  return it + 1;
+}
+
+// Appends `str` with the characters that must be escaped replaced by 
+// their escape sequence; the runs of other characters are copied at once.
+template<bool AsciiOnly>
+inline void append_escaped(std::string& out, StringView str)
+{
+  const char* it = str.begin();
+
+  for (;;)
+  {
+    const char* next = find_escaped<AsciiOnly>(it, str.end());
+    out.append(it, next);
+
+    if (next == str.end())
+      return;
+
+    it = append_escape(out, next, str.end());
+  }
+}
+
+} // namespace details
+
+/*
+ * Writer backend that appends the output to a contiguous buffer.
+ */
+class DefaultWriterBackend
+{
+public:
+  DefaultWriterBackend() = default;
+
+  // Returns whether non-ASCII characters are written as \u escapes.
+  inline bool asciiOnly() const { return m_ascii_only; }
+  inline void setAsciiOnly(bool on) { m_ascii_only = on; }
+
+  // Moves the output out of the backend, which is left empty.
+  std::string result()
+  {
+    std::string output;
+    output.swap(m_buffer);
+    return output;
+  }
+
+  inline const std::string& buffer() const { return m_buffer; }
+  inline std::string& buffer() { return m_buffer; }
 
   DefaultWriterBackend& operator<<(CharCategory c)
   {
     switch (c)
     {
     case CharCategory::Space:
-      result_ << " ";
+      m_buffer.push_back(' ');
       break;
     case CharCategory::NewLine:
-      result_ << "\n";
+      m_buffer.push_back('\n');
       break;
     case CharCategory::LBrace:
-      result_ << "{";
+      m_buffer.push_back('{');
       break;
     case CharCategory::RBrace:
-      result_ << "}";
+      m_buffer.push_back('}');
       break;
     case CharCategory::LBracket:
-      result_ << "[";
+      m_buffer.push_back('[');
       break;
     case CharCategory::RBracket:
-      result_ << "]";
+      m_buffer.push_back(']');
       break;
     case CharCategory::Colon:
-      result_ << ":";
+      m_buffer.push_back(':');
       break;
     case CharCategory::Comma:
-      result_ << ",";
+      m_buffer.push_back(',');
       break;
     case CharCategory::SingleQuote:
-      result_ << "'";
+      m_buffer.push_back('\'');
       break;
     case CharCategory::DoubleQuote:
-      result_ << "\"";
+      m_buffer.push_back('"');
       break;
     default:
       break;
@@ -56,46 +206,57 @@ struct DefaultWriterBackend
     return *this;
   }
 
+  DefaultWriterBackend& operator<<(Indentation indent)
+  {
+    m_buffer.append(indent.width, ' ');
+    return *this;
+  }
+
   DefaultWriterBackend& operator<<(std::nullptr_t)
   {
-    result_ << "null";
+    m_buffer.append("null", 4);
     return *this;
   }
 
   DefaultWriterBackend& operator<<(bool value)
   {
-    result_ << (value ? "true" : "false");
+    if (value)
+      m_buffer.append("true", 4);
+    else
+      m_buffer.append("false", 5);
+
     return *this;
   }
 
-  DefaultWriterBackend & operator<<(int value)
+  DefaultWriterBackend& operator<<(int value)
   {
-    result_ << value;
+    char buffer[16];
+    m_buffer.append(buffer, write_integer(value, buffer));
     return *this;
   }
 
+  // Numbers are written with the fewest digits that read back as the same value.
   DefaultWriterBackend& operator<<(double value)
   {
-    result_ << value;
+    char buffer[32];
+    m_buffer.append(buffer, write_number(value, buffer));
     return *this;
   }
 
-  DefaultWriterBackend& operator<<(const std::string& str)
+  // Writes `str` with quotes, backslashes and control characters escaped.
+  DefaultWriterBackend& operator<<(StringView str)
   {
-    for (char c : str)
-    {
-      if (c == '\\')
-        result_ << "\\\\";
-      else if (c == '\n')
-        result_ << "\\n";
-      else if (c == '\t')
-        result_ << "\\t";
-      else
-        result_ << c;
-    }
+    if (m_ascii_only)
+      details::append_escaped<true>(m_buffer, str);
+    else
+      details::append_escaped<false>(m_buffer, str);
 
     return *this;
   }
+
+private:
+  std::string m_buffer;
+  bool m_ascii_only = false;
 };
 
 } // namespace json
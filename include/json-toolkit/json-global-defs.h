@@ -5,10 +5,15 @@
 #ifndef JSONTOOLKIT_GLOBAL_DEFS_H
 #define JSONTOOLKIT_GLOBAL_DEFS_H
 
+#include <cstring>
 #include <map>
 #include <string>
 #include <vector>
 
+#if __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+#include <string_view>
+#endif // __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+
 namespace json
 {
 
@@ -35,6 +40,101 @@ enum class CharCategory {
   Other,
 };
 
+/*
+ * Whitespace written at the start of a line by a writer, 
+ * `width` spaces.
+ */
+struct Indentation
+{
+  size_t width;
+};
+
+/*
+ * A non-owning reference to a sequence of characters.
+ */
+class StringView
+{
+public:
+  StringView() : m_data(""), m_size(0) { }
+  StringView(const StringView&) = default;
+  ~StringView() = default;
+
+  StringView(const char* str, size_t size) : m_data(str), m_size(size) { }
+  StringView(const char* str) : m_data(str), m_size(std::strlen(str)) { }
+  StringView(const std::string& str) : m_data(str.data()), m_size(str.size()) { }
+
+#if __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+  StringView(std::string_view str) : m_data(str.data()), m_size(str.size()) { }
+  operator std::string_view() const { return std::string_view(m_data, m_size); }
+#endif // __cplusplus >= 201703L || defined(JSONTOOLKIT_CXX17)
+
+  inline const char* data() const { return m_data; }
+  inline size_t size() const { return m_size; }
+  inline bool empty() const { return m_size == 0; }
+
+  inline const char* begin() const { return m_data; }
+  inline const char* end() const { return m_data + m_size; }
+
+  inline char operator[](size_t index) const { return m_data[index]; }
+
+  operator std::string() const { return std::string(m_data, m_size); }
+
+  int compare(StringView other) const
+  {
+    const int c = std::memcmp(m_data, other.m_data, m_size < other.m_size ? m_size : other.m_size);
+
+    if (c != 0)
+      return c;
+
+    return (m_size > other.m_size) - (m_size < other.m_size);
+  }
+
+  StringView& operator=(const StringView&) = default;
+
+private:
+  const char* m_data;
+  size_t m_size;
+};
+
+inline bool operator==(StringView lhs, StringView rhs)
+{
+  return lhs.size() == rhs.size() && std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+inline bool operator!=(StringView lhs, StringView rhs)
+{
+  return !(lhs == rhs);
+}
+
+/*
+ * A non-owning reference to a contiguous sequence of values.
+ */
+template<typename T>
+class Span
+{
+public:
+  Span() : m_data(nullptr), m_size(0) { }
+  Span(const Span&) = default;
+  ~Span() = default;
+
+  Span(T* data, size_t size) : m_data(data), m_size(size) { }
+
+  inline T* data() const { return m_data; }
+  inline size_t size() const { return m_size; }
+  inline bool empty() const { return m_size == 0; }
+
+  inline T* begin() const { return m_data; }
+  inline T* end() const { return m_data + m_size; }
+
+  inline T& operator[](size_t index) const { return m_data[index]; }
+
+  Span& operator=(const Span&) = default;
+
+private:
+  T* m_data;
+  size_t m_size;
+};
+
 } // namespace json
 
 #endif // !JSONTOOLKIT_GLOBAL_DEFS_H
\ No newline at end of file
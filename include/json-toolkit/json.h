@@ -6,10 +6,14 @@
 #define JSONTOOLKIT_JSON_H
 
 #include "json-toolkit/json-global-defs.h"
+#include "json-toolkit/arena.h"
+#include "json-toolkit/flat-map.h"
 
-#include <map>
-#include <memory>
+#include <algorithm>
+#include <atomic>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace json
@@ -29,40 +33,100 @@ enum class JsonType
 namespace details
 {
 
+/*
+ * Base class for the values that are not stored inline in a Json 
+ * (i.e. strings, arrays and objects).
+ * Nodes are reference-counted and shared between Json values.
+ * A node allocated in an Arena is destroyed when its last reference 
+ * goes away but its memory is reclaimed with the arena.
+ * A frozen node is never modified (see Json::freeze()).
+ */
 class Node
 {
 public:
-  Node() = default;
+  explicit Node(Arena* a = nullptr) : ref_count(0), frozen(false), arena(a) { }
   Node(const Node&) = delete;
   virtual ~Node() = default;
 
-  virtual JsonType type() const = 0;
+  mutable std::atomic<int> ref_count;
+  bool frozen;
+  Arena* arena;
 
   Node& operator=(const Node&) = delete;
 };
 
+inline void retain(const Node* node)
+{
+  node->ref_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void release(const Node* node)
+{
+  if (node->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    if (node->arena)
+      node->~Node();
+    else
+      delete node;
+  }
+}
+
+template<typename T, typename...Args>
+T* create_node(Arena* arena, Args&&... args)
+{
+  if (!arena)
+    return new T(nullptr, std::forward<Args>(args)...);
+
+  void* ptr = arena->allocate(sizeof(T), alignof(T));
+  return new (ptr) T(arena, std::forward<Args>(args)...);
+}
+
+class ArrayNode;
+
 } // namespace details
 
 class Array;
+class Json;
 class Object;
 
+typedef std::vector<Json, ArenaAllocator<Json>> ArrayStorage;
+typedef FlatMap<Json, ArenaAllocator<std::pair<Key, Json>>> ObjectStorage;
+
+/*
+ * A Json value.
+ *
+ * Null, booleans, integers and numbers are stored inline; strings,
+ * arrays and objects are stored in a Node shared by all the copies 
+ * of the value.
+ *
+ * Modifying an array or an object modifies all its copies, unless the 
+ * value is frozen: the arrays and objects of a frozen value are copied 
+ * on write, so that only the path to the modified value is copied.
+ * If JSONTOOLKIT_COPY_ON_WRITE is defined, all the arrays and objects
+ * that are shared are copied on write.
+ */
 class Json
 {
 public:
   Json();
-  Json(const Json&) = default;
-  ~Json() = default;
+  Json(const Json& other);
+  Json(Json&& other) noexcept;
+  ~Json() noexcept;
 
   Json(std::nullptr_t);
   Json(bool bval);
   Json(int ival);
   Json(double nval);
   Json(const std::string& str);
+  Json(std::string&& str);
   Json(const char* str);
+  Json(const std::string& str, Arena& arena);
+  Json(std::string&& str, Arena& arena);
 
-  inline Json(const std::shared_ptr<details::Node>& impl) : d(impl) { }
+  // Takes a reference to `impl`, which must be a node of the given type.
+  Json(JsonType type, details::Node* impl);
 
-  inline JsonType type() const { return d->type(); }
+  inline JsonType type() const { return m_type; }
 
   inline bool isNull() const { return type() == JsonType::Null; }
   inline bool isBoolean() const { return type() == JsonType::Boolean; }
@@ -83,32 +147,71 @@ public:
   Json at(int index) const;
   Json& operator[](int index);
   void push(const Json& val);
+  void push(Json&& val);
   Array toArray() const;
 
   /* Object interface */
-  Json& operator[](const std::string& key);
-  Json operator[](const std::string& key) const;
+  Json& operator[](StringView key);
+  Json operator[](StringView key) const;
+  const Json* find(StringView key) const;
+  Json* find(StringView key);
+  bool contains(StringView key) const;
+  Json& insert(Key key, Json value);
   Object toObject() const;
 
-  inline const std::shared_ptr<details::Node>& impl() const { return d; }
+  // Returns the node of strings, arrays and objects, nullptr otherwise.
+  inline details::Node* impl() const { return hasNode() ? m_value.node : nullptr; }
+
+  // Makes the value and all its children immutable; a frozen value can 
+  // be shared between threads and read concurrently, without copies.
+  void freeze();
+  bool isFrozen() const;
 
-  Json& operator=(const Json&) = default;
+  Json& operator=(const Json& other);
+  Json& operator=(Json&& other) noexcept;
 
   Json& operator=(std::nullptr_t);
   Json& operator=(bool val);
   Json& operator=(int val);
   Json& operator=(double val);
   Json& operator=(const std::string& str);
+  Json& operator=(std::string&& str);
   Json& operator=(const char* str);
 
+  void swap(Json& other) noexcept;
+
   inline bool operator==(std::nullptr_t) const { return type() == JsonType::Null; }
 
 protected:
-  std::shared_ptr<details::Node> d;
+  inline bool hasNode() const { return m_type >= JsonType::String; }
+
+  void detach();
+  details::ArrayNode* mutableArrayNode();
+  ArrayStorage& mutableArray();
+  ObjectStorage& mutableObject();
+
+  void assign(JsonType type, details::Node* impl);
+
+protected:
+  JsonType m_type;
+
+  union Value
+  {
+    bool boolean;
+    int integer;
+    double number;
+    details::Node* node;
+  } m_value;
 };
 
+// Json values are moved, rather than copied, when a std::vector grows.
+static_assert(std::is_nothrow_move_constructible<Json>::value, "Json must be nothrow move constructible");
+static_assert(std::is_nothrow_move_assignable<Json>::value, "Json must be nothrow move assignable");
+
 static const Json null = Json(nullptr);
 
+inline void swap(Json& lhs, Json& rhs) noexcept { lhs.swap(rhs); }
+
 int compare(const Json& lhs, const Json& rhs);
 
 bool operator==(const Json& lhs, const Json& rhs);
@@ -117,105 +220,211 @@ inline bool operator!=(const Json& lhs, const Json& rhs) { return !(lhs == rhs);
 namespace details
 {
 
-class NullNode : public Node
+class StringNode : public Node
 {
 public:
-  NullNode() = default;
-  ~NullNode() = default;
+  std::string value;
 
-  JsonType type() const override { return JsonType::Null; }
+public:
+  StringNode(Arena* arena, std::string val) : Node(arena), value(std::move(val)) { }
+  ~StringNode() = default;
+};
 
-  static std::shared_ptr<NullNode> get()
+/*
+ * Hash of a container, which is only cached once the container is
+ * frozen: the nodes of mutable values can be modified through a Json& 
+ * obtained earlier, which cannot be tracked.
+ */
+class HashCache
+{
+public:
+  HashCache() : m_valid(false), m_value(0) { }
+
+  bool get(size_t* value) const
+  {
+    if (!m_valid.load(std::memory_order_acquire))
+      return false;
+
+    *value = m_value.load(std::memory_order_relaxed);
+    return true;
+  }
+
+  void set(size_t value) const
   {
-    static std::shared_ptr<NullNode> static_instance = std::make_shared<NullNode>();
-    return static_instance;
+    m_value.store(value, std::memory_order_relaxed);
+    m_valid.store(true, std::memory_order_release);
   }
+
+private:
+  mutable std::atomic<bool> m_valid;
+  mutable std::atomic<size_t> m_value;
 };
 
-class BooleanNode : public Node
+/*
+ * Contiguous storage of integers or numbers.
+ *
+ * The memory is allocated in the arena passed to the functions, or on
+ * the heap if it is null; it must be released with release().
+ */
+class NumberBuffer
 {
 public:
-  bool value;
+  NumberBuffer() : m_data(nullptr), m_size(0), m_capacity(0), m_type(JsonType::Null) { }
+  NumberBuffer(const NumberBuffer&) = delete;
+  ~NumberBuffer() = default;
 
-public:
-  BooleanNode(bool val) : value(val) { }
-  ~BooleanNode() = default;
+  // Returns JsonType::Null if the buffer is not used.
+  inline JsonType type() const { return m_type; }
+  inline size_t size() const { return m_size; }
+  inline size_t capacity() const { return m_capacity; }
+  inline size_t elementSize() const { return m_type == JsonType::Integer ? sizeof(int) : sizeof(double); }
 
-  JsonType type() const override { return JsonType::Boolean; }
+  inline const int* integers() const { return static_cast<const int*>(m_data); }
+  inline const double* numbers() const { return static_cast<const double*>(m_data); }
 
-  static std::shared_ptr<BooleanNode> True()
+  Json at(size_t index) const;
+
+  // Sets the type of the elements of an unused buffer, which must be
+  // JsonType::Integer or JsonType::Number.
+  inline void setType(JsonType type) { m_type = type; }
+
+  void push(Arena* arena, int val)
   {
-    static std::shared_ptr<BooleanNode> static_instance = std::make_shared<BooleanNode>(true);
-    return static_instance;
+    reserve(arena, m_size + 1);
+    static_cast<int*>(m_data)[m_size++] = val;
   }
 
-  static std::shared_ptr<BooleanNode> False()
+  void push(Arena* arena, double val)
   {
-    static std::shared_ptr<BooleanNode> static_instance = std::make_shared<BooleanNode>(false);
-    return static_instance;
+    reserve(arena, m_size + 1);
+    static_cast<double*>(m_data)[m_size++] = val;
   }
-};
 
-class IntegerNode : public Node
-{
-public:
-  int value;
+  void reserve(Arena* arena, size_t n)
+  {
+    if (n <= m_capacity)
+      return;
 
-public:
-  IntegerNode(int val) : value(val) { }
-  ~IntegerNode() = default;
+    size_t capacity = m_capacity != 0 ? 2 * m_capacity : 4;
 
-  JsonType type() const override { return JsonType::Integer; }
-};
+    while (capacity < n)
+      capacity *= 2;
 
-class NumberNode : public Node
-{
-public:
-  double value;
+    void* data = allocate(arena, capacity * elementSize());
 
-public:
-  NumberNode(double val) : value(val) { }
-  ~NumberNode() = default;
+    if (m_size != 0)
+      std::memcpy(data, m_data, m_size * elementSize());
 
-  JsonType type() const override { return JsonType::Number; }
-};
+    deallocate(arena);
+    m_data = data;
+    m_capacity = capacity;
+  }
 
-class StringNode : public Node
-{
-public:
-  std::string value;
+  void assign(Arena* arena, const NumberBuffer& other)
+  {
+    release(arena);
 
-public:
-  StringNode(std::string val) : value(val) { }
-  ~StringNode() = default;
+    if (other.m_type == JsonType::Null)
+      return;
+
+    m_type = other.m_type;
+    reserve(arena, other.m_size);
 
-  JsonType type() const override { return JsonType::String; }
+    if (other.m_size != 0)
+      std::memcpy(m_data, other.m_data, other.m_size * elementSize());
+
+    m_size = other.m_size;
+  }
+
+  // Frees the memory; the buffer is then unused.
+  void release(Arena* arena)
+  {
+    deallocate(arena);
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+    m_type = JsonType::Null;
+  }
+
+  NumberBuffer& operator=(const NumberBuffer&) = delete;
+
+protected:
+  static void* allocate(Arena* arena, size_t size)
+  {
+    return arena ? arena->allocate(size, alignof(double)) : ::operator new(size);
+  }
+
+  void deallocate(Arena* arena)
+  {
+    if (!arena)
+      ::operator delete(m_data);
+  }
+
+private:
+  void* m_data;
+  uint32_t m_size;
+  uint32_t m_capacity;
+  JsonType m_type;
 };
 
+/*
+ * The elements of an array are stored in `value`, unless they are all
+ * integers or all numbers: they are then packed in `packed` and `value`
+ * is empty.
+ * A packed array is unpacked when a value of another type is added or
+ * when its elements are modified through a Json&.
+ */
 class ArrayNode : public Node
 {
 public:
-  std::vector<Json> value;
+  ArrayStorage value;
+  NumberBuffer packed;
+  HashCache hash_cache;
 
 public:
-  ArrayNode() = default;
-  ArrayNode(std::vector<Json>&& val) : value(std::move(val)) { }
-  ~ArrayNode() = default;
+  explicit ArrayNode(Arena* arena) : Node(arena), value(ArenaAllocator<Json>(arena)), m_elements(nullptr) { }
 
-  JsonType type() const override { return JsonType::Array; }
+  ~ArrayNode()
+  {
+    packed.release(arena);
+    delete m_elements.load(std::memory_order_relaxed);
+  }
+
+  inline bool isPacked() const { return packed.type() != JsonType::Null; }
+  inline size_t size() const { return isPacked() ? packed.size() : value.size(); }
+
+  Json at(size_t index) const;
+  const ArrayStorage& elements() const;
+
+  void push(const Json& val);
+  void push(Json&& val);
+
+  bool pack();
+  ArrayStorage& unpack();
+
+protected:
+  template<typename T>
+  bool pushPacked(const T& val);
+
+  void fill(ArrayStorage& storage) const;
+  void clearElements();
+
+private:
+  // Copy of the elements of a packed array created by elements() for
+  // the readers that need Json values; allocated on the heap as
+  // concurrent readers may use the arena of the node.
+  mutable std::atomic<ArrayStorage*> m_elements;
 };
 
 class ObjectNode : public Node
 {
 public:
-  std::map<std::string, Json> value;
+  ObjectStorage value;
+  HashCache hash_cache;
 
 public:
-  ObjectNode() = default;
-  ObjectNode(std::map<std::string, Json>&& val) : value(std::move(val)) { }
+  explicit ObjectNode(Arena* arena) : Node(arena), value(ArenaAllocator<Json>(arena)) { }
   ~ObjectNode() = default;
-
-  JsonType type() const override { return JsonType::Object; }
 };
 
 } // namespace details
@@ -227,16 +436,31 @@ public:
   Array(const Array&) = default;
   ~Array() = default;
 
-  Array(const std::shared_ptr<details::Node>& impl);
+  // Returns a null value if `value` is not an array.
+  explicit Array(const Json& value);
+
+  // Creates an array whose storage is allocated in `arena`.
+  explicit Array(Arena& arena);
+
+  ArrayStorage& data();
+  const ArrayStorage& data() const;
+
+  // Returns the elements of an array of integers, or of numbers,
+  // that is packed; an empty span otherwise.
+  Span<const int> integers() const;
+  Span<const double> numbers() const;
 
-  std::vector<Json>& data();
-  const std::vector<Json>& data() const;
+  // Stores the elements contiguously if they are all integers or all
+  // numbers; returns whether the array is packed.
+  // Arrays filled with push() are packed as long as their elements
+  // are all integers or all numbers.
+  bool pack();
 
-  inline std::vector<Json>& operator*() { return data(); }
-  inline const std::vector<Json>& operator*() const { return data(); }
+  inline ArrayStorage& operator*() { return data(); }
+  inline const ArrayStorage& operator*() const { return data(); }
 
-  inline std::vector<Json>* operator->() { return &data(); }
-  inline const std::vector<Json>* operator->() const { return &data(); }
+  inline ArrayStorage* operator->() { return &data(); }
+  inline const ArrayStorage* operator->() const { return &data(); }
 
   Array& operator=(const Array&) = default;
 };
@@ -248,154 +472,696 @@ public:
   Object(const Object&) = default;
   ~Object() = default;
 
-  Object(const std::shared_ptr<details::Node>& obj);
+  // Returns a null value if `value` is not an object.
+  explicit Object(const Json& value);
 
-  std::map<std::string, Json>& data();
-  const std::map<std::string, Json>& data() const;
+  // Creates an object whose storage is allocated in `arena`.
+  explicit Object(Arena& arena);
 
-  inline std::map<std::string, Json>& operator*() { return data(); }
-  inline const std::map<std::string, Json>& operator*() const { return data(); }
+  ObjectStorage& data();
+  const ObjectStorage& data() const;
 
-  inline std::map<std::string, Json>* operator->() { return &data(); }
-  inline const std::map<std::string, Json>* operator->() const { return &data(); }
+  inline ObjectStorage& operator*() { return data(); }
+  inline const ObjectStorage& operator*() const { return data(); }
+
+  inline ObjectStorage* operator->() { return &data(); }
+  inline const ObjectStorage* operator->() const { return &data(); }
 
   Object& operator=(const Object&) = default;
 };
 
+/*
+ * A non-owning reference to a Json value.
+ *
+ * Reading a value through a view does not copy any Json, and therefore
+ * does not update any reference count.
+ * The viewed value must outlive the view and must not be modified 
+ * while the view is used.
+ */
+class JsonView
+{
+public:
+  JsonView() : m_value(&null), m_element(nullptr) { }
+  JsonView(const Json& value) : m_value(&value), m_element(nullptr) { }
+  JsonView(const JsonView& other);
+  ~JsonView() = default;
+
+  inline JsonType type() const { return m_value->type(); }
+
+  inline bool isNull() const { return m_value->isNull(); }
+  inline bool isBoolean() const { return m_value->isBoolean(); }
+  inline bool isInteger() const { return m_value->isInteger(); }
+  inline bool isNumber() const { return m_value->isNumber(); }
+  inline bool isString() const { return m_value->isString(); }
+  inline bool isArray() const { return m_value->isArray(); }
+  inline bool isObject() const { return m_value->isObject(); }
+
+  /* Value interface */
+  inline bool toBool() const { return m_value->toBool(); }
+  inline int toInt() const { return m_value->toInt(); }
+  inline double toNumber() const { return m_value->toNumber(); }
+  inline const std::string& toString() const { return m_value->toString(); }
+
+  /* Array interface */
+  int length() const;
+  JsonView at(int index) const;
+  inline JsonView operator[](int index) const { return at(index); }
+  // The elements of packed arrays are copied the first time they
+  // are requested, prefer at() or integers() and numbers().
+  const ArrayStorage& elements() const;
+  Span<const int> integers() const;
+  Span<const double> numbers() const;
+
+  /* Object interface */
+  // Returns a null value if there is no field named `key`.
+  JsonView operator[](StringView key) const;
+  bool contains(StringView key) const;
+  const ObjectStorage& fields() const;
+
+  // Returns the viewed value.
+  inline const Json& json() const { return *m_value; }
+
+  JsonView& operator=(const JsonView& other);
+
+protected:
+  struct Element { };
+
+  // Views an element of a packed array, which the view holds.
+  JsonView(Element, Json element) : m_value(&m_element), m_element(element) { }
+
+private:
+  const Json* m_value;
+  Json m_element;
+};
+
+/*
+ * The elements of an array, as passed to visitors (see visit()).
+ */
+class ArrayView
+{
+public:
+  explicit ArrayView(JsonView array) : m_array(array) { }
+
+  inline int length() const { return m_array.length(); }
+  inline JsonView at(int index) const { return m_array.at(index); }
+  inline JsonView operator[](int index) const { return at(index); }
+
+  inline Span<const int> integers() const { return m_array.integers(); }
+  inline Span<const double> numbers() const { return m_array.numbers(); }
+
+  inline const JsonView& view() const { return m_array; }
+
+private:
+  JsonView m_array;
+};
+
+// Calls `visitor` with the content of `value`, which is one of 
+// std::nullptr_t, bool, int, double, const std::string&, ArrayView
+// and const ObjectStorage&; the type of the value is tested once.
+template<typename Visitor>
+auto visit(Visitor&& visitor, JsonView value) -> decltype(visitor(nullptr));
+
+int compare(JsonView lhs, JsonView rhs);
+
+// Returns a hash of the value that is consistent with operator==:
+// objects with the same fields in a different order have the same hash.
+// The hash of frozen arrays and objects is cached in their node.
+size_t hash(JsonView value);
+size_t hash(const Json& value);
+
 } // namespace json
 
+namespace std
+{
+
+template<>
+struct hash<json::Json>
+{
+  size_t operator()(const json::Json& value) const
+  {
+    return json::hash(value);
+  }
+};
+
+} // namespace std
+
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <stdexcept>
 
 namespace json
 {
 
-inline Json::Json() : d(std::make_shared<details::ObjectNode>()) { }
-inline Json::Json(std::nullptr_t) : d(details::NullNode::get()) { }
-inline Json::Json(bool bval) : d(std::make_shared<details::BooleanNode>(bval)) { }
-inline Json::Json(int ival) : d(std::make_shared<details::IntegerNode>(ival)) { }
-inline Json::Json(double nval) : d(std::make_shared<details::NumberNode>(nval)) { }
-inline Json::Json(const std::string& str) : d(std::make_shared<details::StringNode>(str)) { }
-inline Json::Json(const char* str) : d(std::make_shared<details::StringNode>(str)) { }
+inline Json::Json() : m_type(JsonType::Object)
+{
+  m_value.node = details::create_node<details::ObjectNode>(nullptr);
+  details::retain(m_value.node);
+}
+
+inline Json::Json(const Json& other) : m_type(other.m_type), m_value(other.m_value)
+{
+  if (hasNode())
+    details::retain(m_value.node);
+}
+
+inline Json::Json(Json&& other) noexcept : m_type(other.m_type), m_value(other.m_value)
+{
+  other.m_type = JsonType::Null;
+}
+
+inline Json::~Json() noexcept
+{
+  if (hasNode())
+    details::release(m_value.node);
+}
+
+inline Json::Json(std::nullptr_t) : m_type(JsonType::Null) { m_value.node = nullptr; }
+inline Json::Json(bool bval) : m_type(JsonType::Boolean) { m_value.boolean = bval; }
+inline Json::Json(int ival) : m_type(JsonType::Integer) { m_value.integer = ival; }
+inline Json::Json(double nval) : m_type(JsonType::Number) { m_value.number = nval; }
+inline Json::Json(const std::string& str) : Json(JsonType::String, details::create_node<details::StringNode>(nullptr, str)) { }
+inline Json::Json(const char* str) : Json(JsonType::String, details::create_node<details::StringNode>(nullptr, str)) { }
+inline Json::Json(std::string&& str) : Json(JsonType::String, details::create_node<details::StringNode>(nullptr, std::move(str))) { }
+inline Json::Json(const std::string& str, Arena& arena) : Json(JsonType::String, details::create_node<details::StringNode>(&arena, str)) { }
+inline Json::Json(std::string&& str, Arena& arena) : Json(JsonType::String, details::create_node<details::StringNode>(&arena, std::move(str))) { }
+
+inline Json::Json(JsonType type, details::Node* impl) : m_type(type)
+{
+  assert(hasNode() && impl != nullptr);
+  m_value.node = impl;
+  details::retain(impl);
+}
 
 inline bool Json::toBool() const
 {
   assert(isBoolean());
-  return static_cast<const details::BooleanNode*>(d.get())->value;
+  return m_value.boolean;
 }
 
 inline int Json::toInt() const
 {
   assert(isInteger());
-  return static_cast<const details::IntegerNode*>(d.get())->value;
+  return m_value.integer;
 }
 
 inline double Json::toNumber() const
 {
   assert(isNumber());
-  return static_cast<const details::NumberNode*>(d.get())->value;
+  return m_value.number;
 }
 
 inline const std::string& Json::toString() const
 {
   assert(isString());
-  return static_cast<const details::StringNode*>(d.get())->value;
+  return static_cast<const details::StringNode*>(m_value.node)->value;
+}
+
+namespace details
+{
+
+inline Json NumberBuffer::at(size_t index) const
+{
+  return m_type == JsonType::Integer ? Json(integers()[index]) : Json(numbers()[index]);
 }
 
+inline Json ArrayNode::at(size_t index) const
+{
+  if (index >= size())
+    throw std::out_of_range{ "Json::at()" };
+
+  return isPacked() ? packed.at(index) : value[index];
+}
+
+// Returns the elements as Json values; the elements of a packed array
+// are copied the first time, which may be done concurrently by several
+// readers.
+inline const ArrayStorage& ArrayNode::elements() const
+{
+  if (!isPacked())
+    return value;
+
+  ArrayStorage* result = m_elements.load(std::memory_order_acquire);
+
+  if (result == nullptr)
+  {
+    auto* copy = new ArrayStorage(ArenaAllocator<Json>(nullptr));
+    fill(*copy);
+
+    if (m_elements.compare_exchange_strong(result, copy, std::memory_order_acq_rel))
+      result = copy;
+    else
+      delete copy;
+  }
+
+  return *result;
+}
+
+template<typename T>
+bool ArrayNode::pushPacked(const T& val)
+{
+  if (!val.isInteger() && !val.isNumber())
+    return false;
+
+  if (!isPacked() && value.empty())
+    packed.setType(val.type());
+
+  if (packed.type() != val.type())
+    return false;
+
+  clearElements();
+
+  if (val.isInteger())
+    packed.push(arena, val.toInt());
+  else
+    packed.push(arena, val.toNumber());
+
+  return true;
+}
+
+inline void ArrayNode::push(const Json& val)
+{
+  if (!pushPacked(val))
+    unpack().push_back(val);
+}
+
+inline void ArrayNode::push(Json&& val)
+{
+  if (!pushPacked(val))
+    unpack().push_back(std::move(val));
+}
+
+// Packs the elements if they are all integers or all numbers.
+inline bool ArrayNode::pack()
+{
+  if (isPacked())
+    return true;
+
+  if (value.empty() || (!value.front().isInteger() && !value.front().isNumber()))
+    return false;
+
+  const JsonType type = value.front().type();
+
+  for (const Json& e : value)
+  {
+    if (e.type() != type)
+      return false;
+  }
+
+  packed.setType(type);
+  packed.reserve(arena, value.size());
+
+  for (const Json& e : value)
+  {
+    if (type == JsonType::Integer)
+      packed.push(arena, e.toInt());
+    else
+      packed.push(arena, e.toNumber());
+  }
+
+  ArrayStorage(value.get_allocator()).swap(value);
+  return true;
+}
+
+// Moves the elements of a packed array to `value`, which is returned.
+inline ArrayStorage& ArrayNode::unpack()
+{
+  if (isPacked())
+  {
+    fill(value);
+    packed.release(arena);
+    clearElements();
+  }
+
+  return value;
+}
+
+inline void ArrayNode::fill(ArrayStorage& storage) const
+{
+  storage.reserve(packed.size());
+
+  for (size_t i(0); i < packed.size(); ++i)
+    storage.push_back(packed.at(i));
+}
+
+inline void ArrayNode::clearElements()
+{
+  if (m_elements.load(std::memory_order_relaxed) != nullptr)
+    delete m_elements.exchange(nullptr, std::memory_order_relaxed);
+}
+
+} // namespace details
+
 inline int Json::length() const
 {
   assert(isArray());
-  return (int) static_cast<const details::ArrayNode*>(d.get())->value.size();
+  return (int) static_cast<const details::ArrayNode*>(m_value.node)->size();
 }
 
 inline Json Json::at(int index) const
 {
   assert(isArray());
-  return static_cast<const details::ArrayNode*>(d.get())->value.at(index);
+  return static_cast<const details::ArrayNode*>(m_value.node)->at(index);
 }
 
 inline Json& Json::operator[](int index)
 {
-  assert(isArray());
-  return static_cast<details::ArrayNode*>(d.get())->value[index];
+  return mutableArray()[index];
 }
 
 inline void Json::push(const Json& val)
 {
-  assert(isArray());
-  static_cast<details::ArrayNode*>(d.get())->value.push_back(val);
+  mutableArrayNode()->push(val);
+}
+
+inline void Json::push(Json&& val)
+{
+  mutableArrayNode()->push(std::move(val));
 }
 
 inline Array Json::toArray() const
 {
-  return Array(d);
+  return Array(*this);
 }
 
-inline Json& Json::operator[](const std::string& key)
+inline Json& Json::operator[](StringView key)
 {
-  assert(isObject());
-  return static_cast<details::ObjectNode*>(d.get())->value[key];
+  return mutableObject()[key];
 }
 
-inline Json Json::operator[](const std::string& key) const
+inline Json Json::operator[](StringView key) const
+{
+  const Json* value = find(key);
+  return value ? *value : Json(nullptr);
+}
+
+// Returns the value of the field `key`, or nullptr if there is no such field.
+inline const Json* Json::find(StringView key) const
 {
   assert(isObject());
-  auto* impl = static_cast<details::ObjectNode*>(d.get());
+  auto* impl = static_cast<const details::ObjectNode*>(m_value.node);
   auto it = impl->value.find(key);
-  if (it != impl->value.end())
-    return it->second;
-  return nullptr;
+  return it != impl->value.end() ? &(it->second) : nullptr;
+}
+
+inline Json* Json::find(StringView key)
+{
+  ObjectStorage& fields = mutableObject();
+  auto it = fields.find(key);
+  return it != fields.end() ? &(it->second) : nullptr;
+}
+
+inline bool Json::contains(StringView key) const
+{
+  return find(key) != nullptr;
+}
+
+// Inserts or replaces the field `key`; unlike operator[], no value 
+// is created only to be overwritten.
+inline Json& Json::insert(Key key, Json value)
+{
+  auto it = mutableObject().emplace(std::move(key), std::move(value));
+
+  if (!it.second)
+    it.first->second = std::move(value);
+
+  return it.first->second;
 }
 
 inline Object Json::toObject() const
 {
-  return Object(d);
+  return Object(*this);
+}
+
+inline void Json::freeze()
+{
+  details::Node* node = impl();
+
+  if (node == nullptr || node->frozen)
+    return;
+
+  node->frozen = true;
+
+  if (isArray())
+  {
+    for (Json& e : static_cast<details::ArrayNode*>(node)->value)
+      e.freeze();
+  }
+  else if (isObject())
+  {
+    for (auto& f : static_cast<details::ObjectNode*>(node)->value)
+      f.second.freeze();
+  }
+}
+
+inline bool Json::isFrozen() const
+{
+  return impl() != nullptr && impl()->frozen;
+}
+
+// Replaces the node of an array or an object by a copy if it is frozen
+// (or shared, in copy-on-write mode), so that it can be modified.
+// The elements are not copied: they are detached when they are modified.
+inline void Json::detach()
+{
+  details::Node* node = m_value.node;
+
+#if defined(JSONTOOLKIT_COPY_ON_WRITE)
+  if (!node->frozen && node->ref_count.load(std::memory_order_acquire) == 1)
+    return;
+#else
+  if (!node->frozen)
+    return;
+#endif // defined(JSONTOOLKIT_COPY_ON_WRITE)
+
+  // the copy is allocated on the heap as the arena of the node may
+  // be used by another thread
+  if (isArray())
+  {
+    const auto* array = static_cast<const details::ArrayNode*>(node);
+    auto* copy = details::create_node<details::ArrayNode>(nullptr);
+    copy->value.assign(array->value.begin(), array->value.end());
+    copy->packed.assign(nullptr, array->packed);
+    assign(JsonType::Array, copy);
+  }
+  else
+  {
+    const ObjectStorage& fields = static_cast<const details::ObjectNode*>(node)->value;
+    auto* copy = details::create_node<details::ObjectNode>(nullptr);
+    copy->value.assign(fields.begin(), fields.end());
+    assign(JsonType::Object, copy);
+  }
+}
+
+// Returns the node of the array for modification.
+inline details::ArrayNode* Json::mutableArrayNode()
+{
+  assert(isArray());
+  detach();
+  return static_cast<details::ArrayNode*>(m_value.node);
+}
+
+// Returns the elements of the array for modification; a packed array
+// is unpacked.
+inline ArrayStorage& Json::mutableArray()
+{
+  return mutableArrayNode()->unpack();
+}
+
+inline ObjectStorage& Json::mutableObject()
+{
+  assert(isObject());
+  detach();
+  return static_cast<details::ObjectNode*>(m_value.node)->value;
+}
+
+inline void Json::assign(JsonType type, details::Node* impl)
+{
+  // `impl` may be owned by the current value
+  if (impl)
+    details::retain(impl);
+
+  if (hasNode())
+    details::release(m_value.node);
+
+  m_type = type;
+  m_value.node = impl;
+}
+
+// `other` may be owned by the current value (e.g. j = j["a"]), so it
+// is copied before the current node is released.
+inline Json& Json::operator=(const Json& other)
+{
+  Json(other).swap(*this);
+  return *this;
+}
+
+inline Json& Json::operator=(Json&& other) noexcept
+{
+  Json(std::move(other)).swap(*this);
+  return *this;
+}
+
+inline void Json::swap(Json& other) noexcept
+{
+  std::swap(m_type, other.m_type);
+  std::swap(m_value, other.m_value);
 }
 
 inline Json& Json::operator=(std::nullptr_t)
 {
-  d = details::NullNode::get();
+  assign(JsonType::Null, nullptr);
   return *this;
 }
 
 inline Json& Json::operator=(bool val)
 {
-  d = val ? details::BooleanNode::True() : details::BooleanNode::False();
+  assign(JsonType::Boolean, nullptr);
+  m_value.boolean = val;
   return *this;
 }
 
 inline Json& Json::operator=(int val)
 {
-  d = std::make_shared<details::IntegerNode>(val);
+  assign(JsonType::Integer, nullptr);
+  m_value.integer = val;
   return *this;
 }
 
 inline Json& Json::operator=(double val)
 {
-  d = std::make_shared<details::NumberNode>(val);
+  assign(JsonType::Number, nullptr);
+  m_value.number = val;
   return *this;
 }
 
 inline Json& Json::operator=(const std::string& str)
 {
-  d = std::make_shared<details::StringNode>(str);
+  assign(JsonType::String, details::create_node<details::StringNode>(nullptr, str));
+  return *this;
+}
+
+inline Json& Json::operator=(std::string&& str)
+{
+  assign(JsonType::String, details::create_node<details::StringNode>(nullptr, std::move(str)));
   return *this;
 }
 
 inline Json& Json::operator=(const char* str)
 {
-  d = std::make_shared<details::StringNode>(str);
+  assign(JsonType::String, details::create_node<details::StringNode>(nullptr, str));
   return *this;
 }
 
+inline JsonView::JsonView(const JsonView& other)
+  : m_value(other.m_value == &other.m_element ? &m_element : other.m_value),
+    m_element(other.m_element)
+{
+
+}
+
+inline JsonView& JsonView::operator=(const JsonView& other)
+{
+  m_element = other.m_element;
+  m_value = other.m_value == &other.m_element ? &m_element : other.m_value;
+  return *this;
+}
+
+inline int JsonView::length() const
+{
+  return m_value->length();
+}
+
+inline JsonView JsonView::at(int index) const
+{
+  assert(index >= 0 && index < length());
+  auto* impl = static_cast<const details::ArrayNode*>(m_value->impl());
+
+  if (impl->isPacked())
+    return JsonView(Element(), impl->packed.at(index));
+
+  return impl->value[index];
+}
+
+inline const ArrayStorage& JsonView::elements() const
+{
+  assert(isArray());
+  return static_cast<const details::ArrayNode*>(m_value->impl())->elements();
+}
+
+inline Span<const int> JsonView::integers() const
+{
+  assert(isArray());
+  const details::NumberBuffer& packed = static_cast<const details::ArrayNode*>(m_value->impl())->packed;
+
+  if (packed.type() != JsonType::Integer)
+    return Span<const int>();
+
+  return Span<const int>(packed.integers(), packed.size());
+}
+
+inline Span<const double> JsonView::numbers() const
+{
+  assert(isArray());
+  const details::NumberBuffer& packed = static_cast<const details::ArrayNode*>(m_value->impl())->packed;
+
+  if (packed.type() != JsonType::Number)
+    return Span<const double>();
+
+  return Span<const double>(packed.numbers(), packed.size());
+}
+
+inline JsonView JsonView::operator[](StringView key) const
+{
+  auto it = fields().find(key);
+  return it != fields().end() ? JsonView(it->second) : JsonView();
+}
+
+inline bool JsonView::contains(StringView key) const
+{
+  return fields().count(key) != 0;
+}
+
+inline const ObjectStorage& JsonView::fields() const
+{
+  assert(isObject());
+  return static_cast<const details::ObjectNode*>(m_value->impl())->value;
+}
+
+template<typename Visitor>
+auto visit(Visitor&& visitor, JsonView value) -> decltype(visitor(nullptr))
+{
+  const Json& json = value.json();
+
+  switch (json.type())
+  {
+  case JsonType::Null:
+    return visitor(nullptr);
+  case JsonType::Boolean:
+    return visitor(json.toBool());
+  case JsonType::Integer:
+    return visitor(json.toInt());
+  case JsonType::Number:
+    return visitor(json.toNumber());
+  case JsonType::String:
+    return visitor(json.toString());
+  case JsonType::Array:
+    return visitor(ArrayView(value));
+  case JsonType::Object:
+    return visitor(value.fields());
+  }
+
+  assert(false);
+  throw std::runtime_error{ "json::visit() : corrupted input" };
+}
+
 template<typename T>
-int number_compare(const T* lhs_node, const T* rhs_node)
+int number_compare(T lhs, T rhs)
 {
-  const auto diff = lhs_node->value - rhs_node->value;
-  return (0 < diff) - (diff < 0);
+  return (rhs < lhs) - (lhs < rhs);
 }
 
-inline int array_compare(const Array& lhs, const Array& rhs)
+inline int array_compare(JsonView lhs, JsonView rhs)
 {
   const int size_diff = lhs.length() - rhs.length();
 
@@ -413,24 +1179,59 @@ inline int array_compare(const Array& lhs, const Array& rhs)
   return 0;
 }
 
-inline int object_compare(const Object& lhs, const Object& rhs)
+inline bool object_equal_in_order(JsonView lhs, JsonView rhs)
 {
-  const int size_diff = static_cast<int>(lhs.data().size()) - static_cast<int>(rhs.data().size());
+  auto rhs_it = rhs.fields().begin();
+
+  for (const auto& e : lhs.fields())
+  {
+    if (e.first != rhs_it->first || json::compare(e.second, rhs_it->second) != 0)
+      return false;
+
+    ++rhs_it;
+  }
+
+  return true;
+}
+
+inline std::vector<const ObjectStorage::value_type*> object_sorted_fields(JsonView obj)
+{
+  std::vector<const ObjectStorage::value_type*> result;
+  result.reserve(obj.fields().size());
+
+  for (const auto& e : obj.fields())
+    result.push_back(&e);
+
+  std::sort(result.begin(), result.end(), [](const ObjectStorage::value_type* a, const ObjectStorage::value_type* b) {
+    return a->first < b->first;
+  });
+
+  return result;
+}
+
+// Objects are compared as if their fields were sorted by key, 
+// the insertion order does not matter.
+inline int object_compare(JsonView lhs, JsonView rhs)
+{
+  const int size_diff = static_cast<int>(lhs.fields().size()) - static_cast<int>(rhs.fields().size());
 
   if (size_diff != 0)
     return (0 < size_diff) - (size_diff < 0);
 
-  auto lhs_it = lhs.data().begin();
-  auto rhs_it = rhs.data().begin();
+  if (object_equal_in_order(lhs, rhs))
+    return 0;
+
+  const auto lhs_fields = object_sorted_fields(lhs);
+  const auto rhs_fields = object_sorted_fields(rhs);
 
-  for (; lhs_it != lhs.data().end(); ++lhs_it, ++rhs_it)
+  for (size_t i(0); i < lhs_fields.size(); ++i)
   {
-    int c = lhs_it->first.compare(rhs_it->first);
+    int c = lhs_fields[i]->first.compare(rhs_fields[i]->first);
 
     if (c != 0)
       return c;
 
-    c = json::compare(lhs_it->second, rhs_it->second);
+    c = json::compare(lhs_fields[i]->second, rhs_fields[i]->second);
 
     if (c != 0)
       return c;
@@ -439,93 +1240,312 @@ inline int object_compare(const Object& lhs, const Object& rhs)
   return 0;
 }
 
-inline int compare(const Json& lhs, const Json& rhs)
+namespace details
+{
+
+/*
+ * Compares the visited value with a value of the same type.
+ */
+class Comparator
+{
+public:
+  Comparator(JsonView lhs, JsonView rhs) : m_lhs(lhs), m_rhs(rhs) { }
+
+  int operator()(std::nullptr_t) const { return 0; }
+  int operator()(bool val) const { return static_cast<int>(val) - static_cast<int>(m_rhs.toBool()); }
+  int operator()(int val) const { return number_compare(val, m_rhs.toInt()); }
+  int operator()(double val) const { return number_compare(val, m_rhs.toNumber()); }
+  int operator()(const std::string& str) const { return str.compare(m_rhs.toString()); }
+  int operator()(ArrayView) const { return array_compare(m_lhs, m_rhs); }
+  int operator()(const ObjectStorage&) const { return object_compare(m_lhs, m_rhs); }
+
+private:
+  JsonView m_lhs;
+  JsonView m_rhs;
+};
+
+} // namespace details
+
+inline int compare(JsonView lhs, JsonView rhs)
 {
   const int type_diff = static_cast<int>(lhs.type()) - static_cast<int>(rhs.type());
 
   if (type_diff != 0)
     return (0 < type_diff) - (type_diff < 0);
 
-  switch (lhs.type())
+  if (lhs.json().impl() != nullptr && lhs.json().impl() == rhs.json().impl())
+    return 0;
+
+  return visit(details::Comparator(lhs, rhs), lhs);
+}
+
+inline int compare(const Json& lhs, const Json& rhs)
+{
+  return compare(JsonView(lhs), JsonView(rhs));
+}
+
+namespace details
+{
+
+// splitmix64 finalizer
+inline size_t hash_mix(uint64_t h)
+{
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return static_cast<size_t>(h);
+}
+
+inline size_t number_hash(double x)
+{
+  // -0.0 == 0.0 and NaNs compare equal to each other
+  if (x == 0.0)
+    x = 0.0;
+  else if (std::isnan(x))
+    return hash_mix(0x7ff8000000000000ull);
+
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return hash_mix(bits);
+}
+
+// Returns the hash cache of frozen arrays and objects, nullptr otherwise.
+inline const HashCache* hash_cache(JsonView value)
+{
+  if (!value.json().isFrozen())
+    return nullptr;
+  else if (value.isArray())
+    return &static_cast<const ArrayNode*>(value.json().impl())->hash_cache;
+  else if (value.isObject())
+    return &static_cast<const ObjectNode*>(value.json().impl())->hash_cache;
+  else
+    return nullptr;
+}
+
+inline size_t compute_hash(JsonView value)
+{
+  const size_t seed = hash_mix(static_cast<uint64_t>(value.type()) + 1);
+
+  switch (value.type())
   {
   case JsonType::Null:
-    return 0;
+    return seed;
   case JsonType::Boolean:
-    return static_cast<int>(static_cast<const details::BooleanNode*>(lhs.impl().get())->value)
-      - static_cast<int>(static_cast<const details::BooleanNode*>(rhs.impl().get())->value);
+    return seed ^ hash_mix(value.toBool() ? 2 : 1);
   case JsonType::Integer:
-    return number_compare(static_cast<const details::IntegerNode*>(lhs.impl().get()), static_cast<const details::IntegerNode*>(rhs.impl().get()));
+    return seed ^ hash_mix(static_cast<uint64_t>(static_cast<int64_t>(value.toInt())));
   case JsonType::Number:
-    return number_compare(static_cast<const details::NumberNode*>(lhs.impl().get()), static_cast<const details::NumberNode*>(rhs.impl().get()));
+    return seed ^ number_hash(value.toNumber());
   case JsonType::String:
-    return lhs.toString().compare(rhs.toString());
+    return seed ^ hash_bytes(value.toString().data(), value.toString().size());
   case JsonType::Array:
-    return array_compare(lhs.toArray(), rhs.toArray());
+  {
+    size_t h = seed;
+
+    for (int i(0); i < value.length(); ++i)
+      h = hash_mix(h + json::hash(value.at(i)));
+
+    return h;
+  }
   case JsonType::Object:
-    return object_compare(lhs.toObject(), rhs.toObject());
+  {
+    // fields are combined with a commutative operation so that
+    // the order of the fields does not matter
+    size_t h = 0;
+
+    for (const auto& f : value.fields())
+      h += hash_mix(f.first.hash() ^ (json::hash(f.second) * 0x9e3779b97f4a7c15ull));
+
+    return hash_mix(seed + h);
+  }
   }
 
   assert(false);
-  throw std::runtime_error{ "json::compare() : corrupted inputs" };
+  throw std::runtime_error{ "json::hash() : corrupted input" };
 }
 
-inline bool operator==(const Json& lhs, const Json& rhs)
+// Returns true and sets `h` if the hash of the value is known.
+inline bool cached_hash(JsonView value, size_t* h)
 {
-  if (lhs.impl() == rhs.impl())
-    return true;
+  const HashCache* cache = hash_cache(value);
+  return cache != nullptr && cache->get(h);
+}
 
+inline bool array_equal(JsonView lhs, JsonView rhs)
+{
+  if (lhs.length() != rhs.length())
+    return false;
+
+  if (!lhs.integers().empty() && !rhs.integers().empty())
+    return std::equal(lhs.integers().begin(), lhs.integers().end(), rhs.integers().begin());
+
+  if (!lhs.numbers().empty() && !rhs.numbers().empty())
+  {
+    // numbers are compared as by compare()
+    return std::equal(lhs.numbers().begin(), lhs.numbers().end(), rhs.numbers().begin(), [](double a, double b) {
+      return number_compare(a, b) == 0;
+    });
+  }
+
+  for (int i(0); i < lhs.length(); ++i)
+  {
+    if (lhs.at(i).json() != rhs.at(i).json())
+      return false;
+  }
+
+  return true;
+}
+
+inline bool object_equal(JsonView lhs, JsonView rhs)
+{
+  const ObjectStorage& lhs_fields = lhs.fields();
+  const ObjectStorage& rhs_fields = rhs.fields();
+
+  if (lhs_fields.size() != rhs_fields.size())
+    return false;
+
+  for (const auto& f : lhs_fields)
+  {
+    auto it = rhs_fields.find(f.first);
+
+    if (it == rhs_fields.end() || f.second != it->second)
+      return false;
+  }
+
+  return true;
+}
+
+} // namespace details
+
+inline size_t hash(JsonView value)
+{
+  const details::HashCache* cache = details::hash_cache(value);
+
+  if (cache == nullptr)
+    return details::compute_hash(value);
+
+  size_t h;
+
+  if (cache->get(&h))
+    return h;
+
+  h = details::compute_hash(value);
+  cache->set(h);
+  return h;
+}
+
+inline size_t hash(const Json& value)
+{
+  return hash(JsonView(value));
+}
+
+inline bool operator==(const Json& lhs, const Json& rhs)
+{
   if (lhs.type() != rhs.type())
     return false;
 
-  return json::compare(lhs, rhs) == 0;
+  if (lhs.impl() != nullptr && lhs.impl() == rhs.impl())
+    return true;
+
+  switch (lhs.type())
+  {
+  case JsonType::Null:
+    return true;
+  case JsonType::Boolean:
+    return lhs.toBool() == rhs.toBool();
+  case JsonType::Integer:
+    return lhs.toInt() == rhs.toInt();
+  case JsonType::String:
+    return lhs.toString() == rhs.toString();
+  case JsonType::Array:
+  case JsonType::Object:
+  {
+    // frozen values with different hashes cannot be equal
+    size_t lhs_hash, rhs_hash;
+
+    if (details::cached_hash(lhs, &lhs_hash) && details::cached_hash(rhs, &rhs_hash) && lhs_hash != rhs_hash)
+      return false;
+
+    return lhs.isArray() ? details::array_equal(lhs, rhs) : details::object_equal(lhs, rhs);
+  }
+  default:
+    return json::compare(lhs, rhs) == 0;
+  }
 }
 
 inline Array::Array() 
-  : Json(std::make_shared<details::ArrayNode>())
+  : Json(JsonType::Array, details::create_node<details::ArrayNode>(nullptr))
 {
 
 }
 
-inline Array::Array(const std::shared_ptr<details::Node>& impl)
-  : Json(impl->type() == JsonType::Array ? impl : details::NullNode::get())
+inline Array::Array(Arena& arena)
+  : Json(JsonType::Array, details::create_node<details::ArrayNode>(&arena))
 {
 
 }
 
-inline std::vector<Json>& Array::data()
+inline Array::Array(const Json& value)
+  : Json(value.isArray() ? value : Json(nullptr))
 {
-  assert(isArray());
-  return static_cast<details::ArrayNode*>(d.get())->value;
+
+}
+
+inline ArrayStorage& Array::data()
+{
+  return mutableArray();
 }
 
-inline const std::vector<Json>& Array::data() const
+inline const ArrayStorage& Array::data() const
 {
   assert(isArray());
-  return static_cast<const details::ArrayNode*>(d.get())->value;
+  return static_cast<const details::ArrayNode*>(m_value.node)->elements();
+}
+
+inline Span<const int> Array::integers() const
+{
+  return JsonView(*this).integers();
+}
+
+inline Span<const double> Array::numbers() const
+{
+  return JsonView(*this).numbers();
+}
+
+inline bool Array::pack()
+{
+  return mutableArrayNode()->pack();
 }
 
 inline Object::Object()
-  : Json(std::make_shared<details::ObjectNode>())
+  : Json(JsonType::Object, details::create_node<details::ObjectNode>(nullptr))
 {
 
 }
 
-inline Object::Object(const std::shared_ptr<details::Node>& obj)
-  : Json(obj->type() == JsonType::Object ? obj : details::NullNode::get())
+inline Object::Object(Arena& arena)
+  : Json(JsonType::Object, details::create_node<details::ObjectNode>(&arena))
 {
 
 }
 
-inline std::map<std::string, Json>& Object::data()
+inline Object::Object(const Json& value)
+  : Json(value.isObject() ? value : Json(nullptr))
 {
-  assert(isObject());
-  return static_cast<details::ObjectNode*>(d.get())->value;
+
+}
+
+inline ObjectStorage& Object::data()
+{
+  return mutableObject();
 }
 
-inline const std::map<std::string, Json>& Object::data() const
+inline const ObjectStorage& Object::data() const
 {
   assert(isObject());
-  return static_cast<const details::ObjectNode*>(d.get())->value;
+  return static_cast<const details::ObjectNode*>(m_value.node)->value;
 }
 
 } // namespace json
@@ -0,0 +1,327 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_KEY_H
+#define JSONTOOLKIT_KEY_H
+
+#include "json-toolkit/json-global-defs.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace json
+{
+
+namespace details
+{
+
+// FNV-1a
+inline size_t hash_bytes(const char* data, size_t size)
+{
+  uint64_t h = 14695981039346656037ull;
+
+  for (size_t i(0); i < size; ++i)
+  {
+    h ^= static_cast<unsigned char>(data[i]);
+    h *= 1099511628211ull;
+  }
+
+  return static_cast<size_t>(h ^ (h >> 32));
+}
+
+/*
+ * Immutable, reference-counted character buffer used by the keys
+ * that are too long to be stored inline.
+ */
+struct KeyData
+{
+  mutable std::atomic<int> ref_count;
+  size_t hash;
+  size_t size;
+
+  const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+
+  static KeyData* create(const char* str, size_t size)
+  {
+    void* ptr = ::operator new(sizeof(KeyData) + size + 1);
+    KeyData* result = new (ptr) KeyData;
+    result->ref_count = 1;
+    result->hash = hash_bytes(str, size);
+    result->size = size;
+    char* chars = reinterpret_cast<char*>(result + 1);
+    std::memcpy(chars, str, size);
+    chars[size] = '\0';
+    return result;
+  }
+
+  static void retain(const KeyData* d)
+  {
+    d->ref_count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static void release(const KeyData* d)
+  {
+    if (d->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+      d->~KeyData();
+      ::operator delete(const_cast<KeyData*>(d));
+    }
+  }
+};
+
+} // namespace details
+
+/*
+ * The key of an object field.
+ *
+ * Keys of up to `inline_capacity` characters are stored inline; longer
+ * keys reference an immutable buffer that can be shared between all
+ * the keys with the same value (see KeyPool).
+ * Keys referencing the same buffer are compared by address.
+ */
+class Key
+{
+public:
+  static const size_t inline_capacity = 15;
+
+  Key()
+  {
+    setInline(nullptr, 0);
+  }
+
+  Key(const Key& other)
+  {
+    std::memcpy(m_data, other.m_data, sizeof(m_data));
+
+    if (isShared())
+      details::KeyData::retain(shared());
+  }
+
+  Key(Key&& other) noexcept
+  {
+    std::memcpy(m_data, other.m_data, sizeof(m_data));
+    other.setInline(nullptr, 0);
+  }
+
+  ~Key() noexcept
+  {
+    if (isShared())
+      details::KeyData::release(shared());
+  }
+
+  Key(StringView str)
+  {
+    if (str.size() <= inline_capacity)
+      setInline(str.data(), str.size());
+    else
+      setShared(details::KeyData::create(str.data(), str.size()));
+  }
+
+  Key(const std::string& str) : Key(StringView(str)) { }
+  Key(const char* str) : Key(StringView(str)) { }
+
+  // Takes a reference to `d`.
+  explicit Key(const details::KeyData* d)
+  {
+    details::KeyData::retain(d);
+    setShared(d);
+  }
+
+  inline bool isShared() const { return static_cast<unsigned char>(m_data[inline_capacity]) == shared_tag; }
+
+  const char* data() const
+  {
+    return isShared() ? shared()->data() : m_data;
+  }
+
+  size_t size() const
+  {
+    return isShared() ? shared()->size : inline_capacity - static_cast<size_t>(m_data[inline_capacity]);
+  }
+
+  inline bool empty() const { return size() == 0; }
+
+  inline StringView view() const { return StringView(data(), size()); }
+  inline operator StringView() const { return view(); }
+
+  inline std::string str() const { return std::string(data(), size()); }
+  inline operator std::string() const { return str(); }
+
+  // Returns the same value as details::hash_bytes() on the characters of the key.
+  size_t hash() const
+  {
+    return isShared() ? shared()->hash : details::hash_bytes(m_data, size());
+  }
+
+  int compare(const Key& other) const
+  {
+    return view().compare(other.view());
+  }
+
+  bool equals(const Key& other) const
+  {
+    if (isShared() != other.isShared())
+      return false;
+
+    // unused bytes of inline keys are zeroed
+    if (!isShared())
+      return std::memcmp(m_data, other.m_data, sizeof(m_data)) == 0;
+
+    return shared() == other.shared() || view() == other.view();
+  }
+
+  Key& operator=(const Key& other)
+  {
+    Key copy{ other };
+    return *this = std::move(copy);
+  }
+
+  Key& operator=(Key&& other) noexcept
+  {
+    if (this != &other)
+    {
+      if (isShared())
+        details::KeyData::release(shared());
+
+      std::memcpy(m_data, other.m_data, sizeof(m_data));
+      other.setInline(nullptr, 0);
+    }
+
+    return *this;
+  }
+
+protected:
+  static const unsigned char shared_tag = 0xFF;
+
+  const details::KeyData* shared() const
+  {
+    const details::KeyData* d;
+    std::memcpy(&d, m_data, sizeof(d));
+    return d;
+  }
+
+  void setInline(const char* str, size_t size)
+  {
+    std::memset(m_data, 0, sizeof(m_data));
+
+    if (size)
+      std::memcpy(m_data, str, size);
+
+    m_data[inline_capacity] = static_cast<char>(inline_capacity - size);
+  }
+
+  void setShared(const details::KeyData* d)
+  {
+    std::memset(m_data, 0, sizeof(m_data));
+    std::memcpy(m_data, &d, sizeof(d));
+    m_data[inline_capacity] = static_cast<char>(shared_tag);
+  }
+
+private:
+  char m_data[inline_capacity + 1];
+};
+
+static_assert(std::is_nothrow_move_constructible<Key>::value, "Key must be nothrow move constructible");
+static_assert(std::is_nothrow_move_assignable<Key>::value, "Key must be nothrow move assignable");
+
+inline bool operator==(const Key& lhs, const Key& rhs) { return lhs.equals(rhs); }
+inline bool operator!=(const Key& lhs, const Key& rhs) { return !lhs.equals(rhs); }
+inline bool operator<(const Key& lhs, const Key& rhs) { return lhs.compare(rhs) < 0; }
+
+/*
+ * A set of keys that is used to share the buffer of identical keys.
+ *
+ * A pool can be used for a single parse or shared between parses;
+ * the keys remain valid after the pool is destroyed.
+ * A KeyPool must not be used concurrently by several threads.
+ */
+class KeyPool
+{
+public:
+  KeyPool() : m_size(0) { }
+  KeyPool(const KeyPool&) = delete;
+
+  ~KeyPool()
+  {
+    clear();
+  }
+
+  Key intern(StringView str)
+  {
+    if (str.size() <= Key::inline_capacity)
+      return Key(str);
+
+    if (2 * (m_size + 1) > m_table.size())
+      grow();
+
+    const size_t mask = m_table.size() - 1;
+    const size_t hash = details::hash_bytes(str.data(), str.size());
+    size_t slot = hash & mask;
+
+    for (; m_table[slot] != nullptr; slot = (slot + 1) & mask)
+    {
+      const details::KeyData* d = m_table[slot];
+
+      if (d->hash == hash && StringView(d->data(), d->size) == str)
+        return Key(d);
+    }
+
+    details::KeyData* d = details::KeyData::create(str.data(), str.size());
+    m_table[slot] = d;
+    ++m_size;
+    return Key(d);
+  }
+
+  // Returns the number of keys in the pool.
+  inline size_t size() const { return m_size; }
+
+  void clear()
+  {
+    for (const details::KeyData* d : m_table)
+    {
+      if (d)
+        details::KeyData::release(d);
+    }
+
+    m_table.clear();
+    m_size = 0;
+  }
+
+  KeyPool& operator=(const KeyPool&) = delete;
+
+protected:
+  void grow()
+  {
+    std::vector<const details::KeyData*> table(m_table.empty() ? 64 : 2 * m_table.size(), nullptr);
+    const size_t mask = table.size() - 1;
+
+    for (const details::KeyData* d : m_table)
+    {
+      if (!d)
+        continue;
+
+      size_t slot = d->hash & mask;
+
+      while (table[slot] != nullptr)
+        slot = (slot + 1) & mask;
+
+      table[slot] = d;
+    }
+
+    m_table.swap(table);
+  }
+
+private:
+  std::vector<const details::KeyData*> m_table;
+  size_t m_size;
+};
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_KEY_H
@@ -6,6 +6,8 @@
 #define JSONTOOLKIT_PARSING_H
 
 #include "json-toolkit/json.h"
+#include "json-toolkit/numbers.h"
+#include "json-toolkit/structural-index.h"
 
 namespace json
 {
@@ -56,6 +58,30 @@ inline bool operator!=(const Token& lhs, const Token& rhs)
   return !(lhs == rhs);
 }
 
+/*
+ * A token whose text is not owned; it usually refers directly to 
+ * the input of the Tokenizer.
+ */
+class TokenView
+{
+public:
+  TokenType type;
+  StringView text;
+
+public:
+  TokenView() : type(TokenType::Invalid) { }
+  TokenView(const TokenView&) = default;
+  ~TokenView() = default;
+
+  TokenView(TokenType ttype, StringView str = StringView())
+    : type(ttype), text(str) { }
+
+  TokenView(const Token& tok)
+    : type(tok.type), text(tok.text) { }
+
+  TokenView& operator=(const TokenView&) = default;
+};
+
 /*
 struct TokenizerBackend
 {
@@ -63,16 +89,19 @@ struct TokenizerBackend
   typedef char char_type;
 
   static CharCategory category(char_type c);
-  static bool is_null(const string_type& str);
-  static bool is_bool(const string_type& str, bool* value);
+  static bool is_null(StringView str);
+  static bool is_bool(StringView str, bool* value);
   static char_type new_line();
 
   static size_t size(const string_type& str);
   static char_type at(const string_type& str, size_t index);
   static void clear(string_type& str);
   static void push_back(string_type& str, char_type c);
+  static void append(string_type& str, const char_type* begin, const char_type* end);
 
-  void produce(TokenType ttype, const string_type& str);
+  // The text of the token is only valid during the call, it either refers 
+  // to the input of the tokenizer or to its internal buffer.
+  void produce(TokenType ttype, StringView text);
 };
 */
 
@@ -89,14 +118,111 @@ enum class TokenizerState {
   ParsingDoubleQuoteString,
   ParsingSingleQuoteStringEscape,
   ParsingDoubleQuoteStringEscape,
+  ParsingUnicodeEscape,
+  ParsingLowSurrogate,
 };
 
+namespace details
+{
+
+inline bool is_digit(char c)
+{
+  return '0' <= c && c <= '9';
+}
+
+inline bool is_identifier_char(char c)
+{
+  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || is_digit(c) || c == '_';
+}
+
+// Reads the number or identifier starting at `begin` with the same rules 
+// as the Tokenizer; returns nullptr if the input is invalid.
+inline const char* scan_scalar(const char* begin, const char* end, TokenType* type)
+{
+  const char* it = begin;
+
+  if (is_identifier_char(*it) && !is_digit(*it))
+  {
+    while (it != end && is_identifier_char(*it))
+      ++it;
+
+    *type = TokenType::Identifier;
+    return it;
+  }
+
+  while (it != end && (*it == '+' || *it == '-'))
+    ++it;
+
+  if (it == end || !is_digit(*it))
+    return it == end ? end : nullptr;
+
+  *type = TokenType::Integer;
+
+  while (it != end && is_digit(*it))
+    ++it;
+
+  if (it != end && *it == '.')
+  {
+    *type = TokenType::Number;
+
+    do ++it; while (it != end && is_digit(*it));
+  }
+
+  if (it != end && *it == 'e')
+  {
+    *type = TokenType::Number;
+
+    do ++it; while (it != end && (*it == '+' || *it == '-'));
+
+    if (it == end || !is_digit(*it))
+      return it == end ? end : nullptr;
+
+    while (it != end && is_digit(*it))
+      ++it;
+  }
+
+  return it;
+}
+
+// Returns whether `c` can follow a number (or an identifier) in a valid input.
+inline bool is_scalar_terminator(char c, bool identifier)
+{
+  switch (c)
+  {
+  case ' ':
+  case '\n':
+  case '{':
+  case '}':
+  case '[':
+  case ']':
+  case ':':
+  case ',':
+  case '\'':
+  case '"':
+    return true;
+  case '+':
+  case '-':
+    return identifier;
+  default:
+    return false;
+  }
+}
+
+} // namespace details
+
 template<typename Backend>
 class Tokenizer
 {
 public:
   Tokenizer()
-    : m_state(TokenizerState::Idle)
+    : m_state(TokenizerState::Idle),
+      m_cursor(nullptr),
+      m_token_begin(nullptr),
+      m_token_end(nullptr),
+      m_string_state(TokenizerState::Idle),
+      m_code_unit(0),
+      m_hex_digits(0),
+      m_high_surrogate(0)
   {
 
   }
@@ -111,6 +237,140 @@ public:
   inline String& buffer() { return m_buffer; }
 
   void write(Char c)
+  {
+    write(&c, &c + 1);
+  }
+
+  void write(const Char* begin, const Char* end)
+  {
+    for (m_cursor = begin; m_cursor != end; ++m_cursor)
+    {
+      if (!skipStringContent(end))
+        break;
+
+      process(*m_cursor);
+    }
+
+    // the input may not outlive this call, pending token text is copied
+    spill();
+  }
+
+  void write(const String& str)
+  {
+    write(str.data(), str.data() + m_backend.size(str));
+  }
+
+  // Same as write() but, when the tokenizer is idle, the input is read 
+  // through a StructuralIndex rather than character by character.
+  // Single-quoted strings and strings containing escape sequences are
+  // still processed with the state machine.
+  void writeIndexed(const Char* begin, const Char* end)
+  {
+    if (m_state != TokenizerState::Idle)
+      begin = processUntilIdle(begin, end);
+
+    StructuralIndex index{ begin, static_cast<size_t>(end - begin) };
+
+    for (size_t pos = index.next(); pos != StructuralIndex::npos; pos = index.next())
+    {
+      const Char* it = begin + pos;
+
+      switch (*it)
+      {
+      case '{':
+        produce(TokenType::LBrace);
+        break;
+      case '}':
+        produce(TokenType::RBrace);
+        break;
+      case '[':
+        produce(TokenType::LBracket);
+        break;
+      case ']':
+        produce(TokenType::RBracket);
+        break;
+      case ':':
+        produce(TokenType::Colon);
+        break;
+      case ',':
+        produce(TokenType::Comma);
+        break;
+      case '"':
+      {
+        const size_t close = index.next();
+
+        if (close != StructuralIndex::npos && begin[close] == '"')
+        {
+          m_token_begin = it;
+          m_token_end = begin + close + 1;
+          produce(TokenType::StringLiteral);
+        }
+        else
+        {
+          const Char* stop = processUntilIdle(it, end);
+          index.skip(stop - begin);
+        }
+      }
+      break;
+      case '\'':
+        return write(it, end);
+      default:
+      {
+        TokenType type = TokenType::Invalid;
+        const Char* stop = details::scan_scalar(it, end, &type);
+
+        // the token may continue in the next input
+        if (stop == end)
+          return write(it, end);
+
+        if (!stop || !details::is_scalar_terminator(*stop, type == TokenType::Identifier))
+          throw std::runtime_error{ "Invalid input" };
+
+        m_token_begin = it;
+        m_token_end = stop;
+
+        if (type == TokenType::Identifier)
+          produceIdentifier();
+        else
+          produce(type);
+      }
+      break;
+      }
+    }
+  }
+
+  void writeIndexed(const String& str)
+  {
+    writeIndexed(str.data(), str.data() + m_backend.size(str));
+  }
+
+  void done()
+  {
+    write(m_backend.new_line());
+  }
+
+protected:
+  // Processes the input until the tokenizer goes back to the 'Idle' state,
+  // returns the position of the first character that was not read.
+  const Char* processUntilIdle(const Char* begin, const Char* end)
+  {
+    for (m_cursor = begin; m_cursor != end; )
+    {
+      if (!skipStringContent(end))
+        break;
+
+      process(*m_cursor);
+      ++m_cursor;
+
+      if (m_state == TokenizerState::Idle)
+        return m_cursor;
+    }
+
+    spill();
+    return end;
+  }
+
+  void process(Char c)
   {
     CharCategory cc = m_backend.category(c);
 
@@ -131,43 +391,104 @@ public:
     case TokenizerState::ParsingDoubleQuoteString: return StateParsingDoubleQuoteString(c, cc);
     case TokenizerState::ParsingSingleQuoteStringEscape: return StateParsingSingleQuoteStringEscape(c, cc);
     case TokenizerState::ParsingDoubleQuoteStringEscape: return StateParsingDoubleQuoteStringEscape(c, cc);
+    case TokenizerState::ParsingUnicodeEscape: return StateParsingUnicodeEscape(c, cc);
+    case TokenizerState::ParsingLowSurrogate: return StateParsingLowSurrogate(c, cc);
     }
   }
 
-  void write(const String& str)
-  {
-    auto s = m_backend.size(str);
-    for (decltype(s) i = 0; i < s; ++i)
-      write(m_backend.at(str, i));
-  }
-
-  void done()
+  // Returns the text of the token being read.
+  StringView text() const
   {
-    write(m_backend.new_line());
+    if (m_token_begin)
+      return StringView(m_token_begin, m_token_end - m_token_begin);
+    else
+      return StringView(m_buffer);
   }
 
-protected:
   void produce(TokenType t)
   {
-    m_backend.produce(t, m_buffer);
-    m_buffer.clear();
+    m_backend.produce(t, text());
+    m_token_begin = nullptr;
+    m_backend.clear(m_buffer);
   }
 
   void produceIdentifier()
   {
     bool value;
 
-    if (m_backend.is_bool(m_buffer, &value))
+    if (m_backend.is_bool(text(), &value))
       produce(value ? TokenType::True : TokenType::False);
-    else if (m_backend.is_null(m_buffer))
+    else if (m_backend.is_null(text()))
       produce(TokenType::Null);
     else
       produce(TokenType::Identifier);
   }
 
+  // Appends the character under the cursor to the current token.
+  // As long as the token is contiguous in the input, it is only 
+  // tracked by a pair of pointers and nothing is copied.
   void push(Char c)
   {
-    m_backend.push_back(m_buffer, c);
+    if (m_token_begin && m_token_end == m_cursor)
+    {
+      ++m_token_end;
+    }
+    else if (!m_token_begin && m_backend.size(m_buffer) == 0)
+    {
+      m_token_begin = m_cursor;
+      m_token_end = m_cursor + 1;
+    }
+    else
+    {
+      spill();
+      m_backend.push_back(m_buffer, c);
+    }
+  }
+
+  // Copies the current token to the internal buffer, this is required
+  // when the token is no longer a contiguous part of the input.
+  void spill()
+  {
+    if (!m_token_begin)
+      return;
+
+    m_backend.append(m_buffer, m_token_begin, m_token_end);
+    m_token_begin = nullptr;
+  }
+
+  // When reading a string, moves the cursor to the next character that 
+  // is not a regular character of the string and appends all the 
+  // characters that were skipped to the current token.
+  // Returns false if the end of the input was reached.
+  bool skipStringContent(const Char* end)
+  {
+    Char quote;
+
+    if (m_state == TokenizerState::ParsingDoubleQuoteString)
+      quote = '"';
+    else if (m_state == TokenizerState::ParsingSingleQuoteString)
+      quote = '\'';
+    else
+      return true;
+
+    const Char* stop = details::find_string_delimiter(m_cursor, end, quote);
+
+    if (stop != m_cursor)
+    {
+      if (m_token_begin && m_token_end == m_cursor)
+      {
+        m_token_end = stop;
+      }
+      else
+      {
+        spill();
+        m_backend.append(m_buffer, m_cursor, stop);
+      }
+
+      m_cursor = stop;
+    }
+
+    return stop != end;
   }
 
   void enter(TokenizerState s)
@@ -470,26 +791,144 @@ protected:
       return '\'';
     else if (c == '\\')
       return '\\';
+    else if (c == '/')
+      return '/';
+    else if (c == 'b')
+      return '\b';
+    else if (c == 'f')
+      return '\f';
     else
       throw std::runtime_error(std::string("Could not unescape char: ") + c);
   }
 
+  // Handles the character following a backslash in a string, 
+  // `string_state` is the state of the string.
+  void unescape(Char c, TokenizerState string_state)
+  {
+    spill();
+
+    if (c == 'u')
+    {
+      m_string_state = string_state;
+      m_code_unit = 0;
+      m_hex_digits = 0;
+      return enter(TokenizerState::ParsingUnicodeEscape);
+    }
+    else if (m_high_surrogate != 0)
+    {
+      throw std::runtime_error{ "Invalid input: unpaired surrogate in \\u escape sequence" };
+    }
+
+    m_backend.push_back(m_buffer, unescaped(c));
+    enter(string_state);
+  }
+
   void StateParsingSingleQuoteStringEscape(Char c, CharCategory cc)
   {
-    push(unescaped(c));
-    enter(TokenizerState::ParsingSingleQuoteString);
+    unescape(c, TokenizerState::ParsingSingleQuoteString);
   }
 
   void StateParsingDoubleQuoteStringEscape(Char c, CharCategory cc)
   {
-    push(unescaped(c));
-    enter(TokenizerState::ParsingDoubleQuoteString);
+    unescape(c, TokenizerState::ParsingDoubleQuoteString);
+  }
+
+  // Reads the four hexadecimal digits of a \uXXXX escape sequence; 
+  // the code point is appended to the string encoded in UTF-8.
+  // A high surrogate must be followed by the escaped low surrogate.
+  void StateParsingUnicodeEscape(Char c, CharCategory cc)
+  {
+    uint32_t digit;
+
+    if ('0' <= c && c <= '9')
+      digit = c - '0';
+    else if ('a' <= c && c <= 'f')
+      digit = c - 'a' + 10;
+    else if ('A' <= c && c <= 'F')
+      digit = c - 'A' + 10;
+    else
+      throw std::runtime_error{ "Invalid input in 'ParsingUnicodeEscape' state" };
+
+    m_code_unit = (m_code_unit << 4) | digit;
+
+    if (++m_hex_digits < 4)
+      return;
+
+    const bool is_high = 0xD800 <= m_code_unit && m_code_unit <= 0xDBFF;
+    const bool is_low = 0xDC00 <= m_code_unit && m_code_unit <= 0xDFFF;
+
+    if (m_high_surrogate != 0)
+    {
+      if (!is_low)
+        throw std::runtime_error{ "Invalid input: unpaired surrogate in \\u escape sequence" };
+
+      appendCodePoint(0x10000 + ((m_high_surrogate - 0xD800) << 10) + (m_code_unit - 0xDC00));
+      m_high_surrogate = 0;
+    }
+    else if (is_high)
+    {
+      m_high_surrogate = m_code_unit;
+      return enter(TokenizerState::ParsingLowSurrogate);
+    }
+    else if (is_low)
+    {
+      throw std::runtime_error{ "Invalid input: unpaired surrogate in \\u escape sequence" };
+    }
+    else
+    {
+      appendCodePoint(m_code_unit);
+    }
+
+    enter(m_string_state);
+  }
+
+  void StateParsingLowSurrogate(Char c, CharCategory cc)
+  {
+    if (cc != CharCategory::Escape)
+      throw std::runtime_error{ "Invalid input: unpaired surrogate in \\u escape sequence" };
+
+    enter(m_string_state == TokenizerState::ParsingSingleQuoteString ? 
+      TokenizerState::ParsingSingleQuoteStringEscape : TokenizerState::ParsingDoubleQuoteStringEscape);
+  }
+
+  void appendCodePoint(uint32_t cp)
+  {
+    if (cp < 0x80)
+    {
+      m_backend.push_back(m_buffer, static_cast<Char>(cp));
+    }
+    else if (cp < 0x800)
+    {
+      m_backend.push_back(m_buffer, static_cast<Char>(0xC0 | (cp >> 6)));
+      m_backend.push_back(m_buffer, static_cast<Char>(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000)
+    {
+      m_backend.push_back(m_buffer, static_cast<Char>(0xE0 | (cp >> 12)));
+      m_backend.push_back(m_buffer, static_cast<Char>(0x80 | ((cp >> 6) & 0x3F)));
+      m_backend.push_back(m_buffer, static_cast<Char>(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+      m_backend.push_back(m_buffer, static_cast<Char>(0xF0 | (cp >> 18)));
+      m_backend.push_back(m_buffer, static_cast<Char>(0x80 | ((cp >> 12) & 0x3F)));
+      m_backend.push_back(m_buffer, static_cast<Char>(0x80 | ((cp >> 6) & 0x3F)));
+      m_backend.push_back(m_buffer, static_cast<Char>(0x80 | (cp & 0x3F)));
+    }
   }
 
 private:
   Backend m_backend;
   String m_buffer;
   TokenizerState m_state;
+  const Char* m_cursor;
+  const Char* m_token_begin;
+  const Char* m_token_end;
+  // state of the string containing the \u escape sequence being read
+  TokenizerState m_string_state;
+  uint32_t m_code_unit;
+  int m_hex_digits;
+  uint32_t m_high_surrogate;
 };
 
 } // namespace json
@@ -499,9 +938,11 @@ namespace json
 /*
 struct ParserBackend
 {
-  static int parse_integer(const std::string& str);
-  static double parse_number(const std::string& str);
-  static std::string unquote(const std::string& str);
+  // Returns false if the integer is too large, in which case it is 
+  // read with parse_number().
+  static bool parse_integer(StringView str, int* value);
+  static double parse_number(StringView str);
+  static std::string unquote(StringView str);
 
   void value(std::nullptr_t);
   void value(bool val);
@@ -546,7 +987,7 @@ public:
   inline Backend& backend() { return m_backend; }
   inline std::vector<Token> & buffer() { return m_buffer; }
 
-  void write(const Token& tok)
+  void write(const TokenView& tok)
   {
     switch (state())
     {
@@ -573,6 +1014,16 @@ protected:
     m_states.back() = s;
   }
 
+  void writeInteger(StringView text)
+  {
+    int value;
+
+    if (m_backend.parse_integer(text, &value))
+      m_backend.value(value);
+    else
+      m_backend.value(m_backend.parse_number(text));
+  }
+
   void leave()
   {
     m_states.pop_back();
@@ -583,7 +1034,7 @@ protected:
       m_states.back() = ParserState::ReadArrayElement;
   }
 
-  void StateIdle(const Token& tok)
+  void StateIdle(const TokenView& tok)
   {
     switch (tok.type)
     {
@@ -601,7 +1052,7 @@ protected:
     }
   }
 
-  void StateParsingObject(const Token& tok)
+  void StateParsingObject(const TokenView& tok)
   {
     switch (tok.type)
     {
@@ -623,7 +1074,7 @@ protected:
     }
   }
 
-  void StateReadFieldName(const Token& tok)
+  void StateReadFieldName(const TokenView& tok)
   {
     switch (tok.type)
     {
@@ -636,7 +1087,7 @@ protected:
     }
   }
 
-  void StateReadFieldColon(const Token& tok)
+  void StateReadFieldColon(const TokenView& tok)
   {
     switch (tok.type)
     {
@@ -658,7 +1109,7 @@ protected:
       update(ParserState::ReadFieldValue);
       return;
     case TokenType::Integer:
-      m_backend.value(m_backend.parse_integer(tok.text));
+      writeInteger(tok.text);
       update(ParserState::ReadFieldValue);
       return;
     case TokenType::Number:
@@ -675,7 +1126,7 @@ protected:
     }
   }
 
-  void StateReadFieldValue(const Token& tok)
+  void StateReadFieldValue(const TokenView& tok)
   {
     switch (tok.type)
     {
@@ -692,7 +1143,7 @@ protected:
     }
   }
 
-  void StateParsingArray(const Token& tok)
+  void StateParsingArray(const TokenView& tok)
   {
     switch (tok.type)
     {
@@ -714,7 +1165,7 @@ protected:
       update(ParserState::ReadArrayElement);
       return;
     case TokenType::Integer:
-      m_backend.value(m_backend.parse_integer(tok.text));
+      writeInteger(tok.text);
       update(ParserState::ReadArrayElement);
       return;
     case TokenType::Number:
@@ -735,7 +1186,7 @@ protected:
     }
   }
 
-  void StateReadArrayElement(const Token& tok)
+  void StateReadArrayElement(const TokenView& tok)
   {
     switch (tok.type)
     {
@@ -752,7 +1203,7 @@ protected:
     }
   }
 
-  void StateReadArraySeparator(const Token& tok)
+  void StateReadArraySeparator(const TokenView& tok)
   {
     update(ParserState::ParsingArray);
     return StateParsingArray(tok);
@@ -770,10 +1221,8 @@ private:
 namespace json
 {
 
-struct DefaultTokenizerBackend
+struct BasicTokenizerBackend
 {
-  std::vector<json::Token> token_buffer;
-
   typedef std::string string_type;
   typedef char char_type;
 
@@ -816,12 +1265,12 @@ struct DefaultTokenizerBackend
     return CharCategory::Other;
   }
 
-  static bool is_null(const string_type& str)
+  static bool is_null(StringView str)
   {
     return str == "null";
   }
 
-  static bool is_bool(const string_type& str, bool* value)
+  static bool is_bool(StringView str, bool* value)
   {
     if (str == "true")
     {
@@ -859,52 +1308,71 @@ struct DefaultTokenizerBackend
     str.push_back(c);
   }
 
-  void produce(json::TokenType ttype, const string_type& str)
+  static void append(string_type& str, const char_type* begin, const char_type* end)
+  {
+    str.append(begin, end);
+  }
+};
+
+struct DefaultTokenizerBackend : public BasicTokenizerBackend
+{
+  std::vector<json::Token> token_buffer;
+
+  void produce(json::TokenType ttype, StringView text)
   {
-    json::Token tok{ ttype, str };
+    json::Token tok{ ttype, text };
     token_buffer.push_back(tok);
   }
 };
 
 struct DefaultParserBackend
 {
-  static int parse_integer(const std::string& str)
+  static bool parse_integer(StringView str, int* value)
   {
-    return std::stoi(str);
+    const NumberError error = json::read_integer(str, value);
+
+    if (error == NumberError::InvalidInput)
+      throw std::runtime_error{ "Invalid integer" };
+
+    return error == NumberError::None;
   }
 
-  static double parse_number(const std::string& str)
+  static double parse_number(StringView str)
   {
-    return std::stod(str);
+    double value;
+    const NumberError error = json::read_number(str, &value);
+
+    if (error == NumberError::InvalidInput)
+      throw std::runtime_error{ "Invalid number" };
+    else if (error == NumberError::OutOfRange)
+      throw std::runtime_error{ "Number out of range" };
+
+    return value;
   }
 
-  static std::string unquote(std::string str)
+  static std::string unquote(StringView str)
   {
     return std::string(str.begin() + 1, str.end() - 1);
   }
 
-  void writeField(const json::Json& value)
+  void writeField(json::Json value)
   {
-    assert(stack.back().isString());
-
-    std::string key = stack.back().toString();
-    stack.pop_back();
-
     assert(stack.back().isObject());
 
-    stack.back()[key] = value;
+    stack.back().insert(std::move(keys.back()), std::move(value));
+    keys.pop_back();
   }
 
-  void writeValue(const json::Json& value)
+  void writeValue(json::Json value)
   {
-    if (stack.back().isString())
+    if (stack.back().isObject())
     {
-      writeField(value);
+      writeField(std::move(value));
     }
     else
     {
       assert(stack.back().isArray());
-      stack.back().push(value);
+      stack.back().push(std::move(value));
     }
   }
 
@@ -928,20 +1396,30 @@ struct DefaultParserBackend
     writeValue(json::Json(val));
   }
 
+  json::Json make_string(std::string str) const
+  {
+    return arena ? json::Json(std::move(str), *arena) : json::Json(std::move(str));
+  }
+
   void value(const std::string& str)
   {
-    writeValue(json::Json(str));
+    writeValue(make_string(str));
+  }
+
+  void value(std::string&& str)
+  {
+    writeValue(make_string(std::move(str)));
   }
 
   void start_object()
   {
-    stack.push_back(json::Object());
+    stack.push_back(arena ? json::Object(*arena) : json::Object());
   }
 
   void key(const std::string& str)
   {
     assert(stack.back().isObject());
-    stack.push_back(json::Json(str));
+    keys.push_back(pool ? pool->intern(str) : json::Key(str));
   }
 
   void end_object()
@@ -949,29 +1427,15 @@ struct DefaultParserBackend
     if (stack.size() == 1)
       return;
 
-    auto object = stack.back();
+    json::Json object = std::move(stack.back());
     stack.pop_back();
 
-    if (stack.back().isString())
-    {
-      std::string key = stack.back().toString();
-      stack.pop_back();
-
-      assert(stack.back().isObject());
-
-      stack.back()[key] = object;
-
-    }
-    else if (stack.back().isArray())
-    {
-      json::Array a = stack.back().toArray();
-      a.push(object);
-    }
+    writeValue(std::move(object));
   }
 
   void start_array()
   {
-    stack.push_back(json::Array());
+    stack.push_back(arena ? json::Array(*arena) : json::Array());
   }
 
   void end_array()
@@ -979,27 +1443,38 @@ struct DefaultParserBackend
     if (stack.size() == 1)
       return;
 
-    auto vec = stack.back();
+    json::Json vec = std::move(stack.back());
     stack.pop_back();
 
-    if (stack.back().isString())
-    {
-      std::string key = stack.back().toString();
-      stack.pop_back();
+    writeValue(std::move(vec));
+  }
 
-      assert(stack.back().isObject());
+  std::vector<json::Json> stack;
 
-      stack.back()[key] = vec;
+  // The keys of the fields being read.
+  std::vector<json::Key> keys;
 
-    }
-    else if (stack.back().isArray())
-    {
-      json::Array a = stack.back().toArray();
-      a.push(vec);
-    }
-  }
+  // If not null, the values are allocated in this arena.
+  json::Arena* arena = nullptr;
 
-  std::vector<json::Json> stack;
+  // If not null, the keys are interned in this pool.
+  json::KeyPool* pool = nullptr;
+};
+
+/*
+ * Tokenizer backend that feeds each token to a ParserMachine as soon as 
+ * it is complete; no token is stored and the token text is not copied,
+ * so memory usage does not depend on the size of the input.
+ */
+template<typename ParserBackend>
+struct ParsingTokenizerBackend : public BasicTokenizerBackend
+{
+  ParserMachine<ParserBackend> parser;
+
+  void produce(json::TokenType ttype, StringView text)
+  {
+    parser.write(json::TokenView(ttype, text));
+  }
 };
 
 } // namespace json
@@ -1007,21 +1482,43 @@ struct DefaultParserBackend
 namespace json
 {
 
+// Parses `str`; the identical keys of the document share their memory.
 inline json::Json parse(const std::string& str)
 {
-  Tokenizer<DefaultTokenizerBackend> tokenizer;
-  auto& buffer = tokenizer.backend().token_buffer;
-  tokenizer.write(str);
+  KeyPool pool;
+  Tokenizer<ParsingTokenizerBackend<DefaultParserBackend>> tokenizer;
+  tokenizer.backend().parser.backend().pool = &pool;
+  tokenizer.writeIndexed(str);
   tokenizer.done();
 
-  ParserMachine<DefaultParserBackend> parser;
-  
-  for (const auto& tok : buffer)
-  {
-    parser.write(tok);
-  }
+  return std::move(tokenizer.backend().parser.backend().stack.front());
+}
+
+// Parses `str`, sharing the memory of the keys with the keys of 
+// previous parses that used the same pool.
+inline json::Json parse(const std::string& str, KeyPool& pool)
+{
+  Tokenizer<ParsingTokenizerBackend<DefaultParserBackend>> tokenizer;
+  tokenizer.backend().parser.backend().pool = &pool;
+  tokenizer.writeIndexed(str);
+  tokenizer.done();
+
+  return std::move(tokenizer.backend().parser.backend().stack.front());
+}
+
+// Parses `str`, allocating the strings, arrays and objects in `arena`.
+// The returned value must not outlive the arena.
+// If `pool` is not null, it is used to intern the keys.
+inline json::Json parse(const std::string& str, Arena& arena, KeyPool* pool = nullptr)
+{
+  KeyPool local_pool;
+  Tokenizer<ParsingTokenizerBackend<DefaultParserBackend>> tokenizer;
+  tokenizer.backend().parser.backend().arena = &arena;
+  tokenizer.backend().parser.backend().pool = pool ? pool : &local_pool;
+  tokenizer.writeIndexed(str);
+  tokenizer.done();
 
-  return parser.backend().stack.front();
+  return std::move(tokenizer.backend().parser.backend().stack.front());
 }
 
 } // namespace json
@@ -0,0 +1,596 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_PERSISTENT_H
+#define JSONTOOLKIT_PERSISTENT_H
+
+#include "json-toolkit/json.h"
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace json
+{
+
+namespace details
+{
+
+inline int popcount(uint32_t x)
+{
+#if defined(_MSC_VER)
+  return static_cast<int>(__popcnt(x));
+#else
+  return __builtin_popcount(x);
+#endif
+}
+
+/*
+ * Reference-counted pointer to a node of a persistent container.
+ *
+ * Nodes are only modified while they are referenced once, by the
+ * container that is being built.
+ */
+template<typename T>
+class Ref
+{
+public:
+  Ref() : m_ptr(nullptr) { }
+
+  explicit Ref(T* ptr) : m_ptr(ptr)
+  {
+    if (m_ptr)
+      m_ptr->ref_count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Ref(const Ref& other) : Ref(other.m_ptr) { }
+
+  Ref(Ref&& other) : m_ptr(other.m_ptr)
+  {
+    other.m_ptr = nullptr;
+  }
+
+  ~Ref()
+  {
+    if (m_ptr && m_ptr->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete m_ptr;
+  }
+
+  inline T* get() const { return m_ptr; }
+  inline T* operator->() const { return m_ptr; }
+  inline T& operator*() const { return *m_ptr; }
+  inline explicit operator bool() const { return m_ptr != nullptr; }
+
+  // Returns true if the node can be modified in place.
+  inline bool unique() const { return m_ptr->ref_count.load(std::memory_order_acquire) == 1; }
+
+  Ref& operator=(Ref other)
+  {
+    std::swap(m_ptr, other.m_ptr);
+    return *this;
+  }
+
+private:
+  T* m_ptr;
+};
+
+/*
+ * Node of a hash array mapped trie.
+ *
+ * Each slot is either a field or a child node; the slots are indexed
+ * by 5 bits of the hash of the keys. Keys whose hashes are equal are
+ * stored in a collision node, below the last level.
+ */
+struct HamtNode
+{
+  struct Slot
+  {
+    Ref<HamtNode> child;
+    size_t hash;
+    Key key;
+    Json value;
+  };
+
+  std::atomic<int> ref_count;
+  uint32_t bitmap;
+  std::vector<Slot> slots;
+
+  HamtNode() : ref_count(0), bitmap(0) { }
+  HamtNode(const HamtNode& other) : ref_count(0), bitmap(other.bitmap), slots(other.slots) { }
+};
+
+static const unsigned hamt_bits = 5;
+static const unsigned hamt_hash_bits = sizeof(size_t) * 8;
+
+inline size_t hamt_hash(StringView key)
+{
+  return hash_mix(hash_bytes(key.data(), key.size()));
+}
+
+// Gives `node` its own copy of the node it references, unless it can be
+// modified in place.
+template<typename T>
+void make_writable(Ref<T>& node, bool in_place)
+{
+  if (!node)
+    node = Ref<T>(new T());
+  else if (!in_place || !node.unique())
+    node = Ref<T>(new T(*node));
+}
+
+inline const Json* hamt_find(const HamtNode* node, size_t hash, StringView key)
+{
+  for (unsigned shift = 0; node != nullptr; shift += hamt_bits)
+  {
+    if (shift >= hamt_hash_bits)
+    {
+      for (const HamtNode::Slot& slot : node->slots)
+      {
+        if (slot.key.view() == key)
+          return &slot.value;
+      }
+
+      return nullptr;
+    }
+
+    const uint32_t bit = uint32_t(1) << ((hash >> shift) & 31);
+
+    if (!(node->bitmap & bit))
+      return nullptr;
+
+    const HamtNode::Slot& slot = node->slots[popcount(node->bitmap & (bit - 1))];
+
+    if (!slot.child)
+      return slot.hash == hash && slot.key.view() == key ? &slot.value : nullptr;
+
+    node = slot.child.get();
+  }
+
+  return nullptr;
+}
+
+// Sets the value of `key`, copying the nodes on the path to the key
+// unless `in_place` is true and they are not shared.
+inline void hamt_set(Ref<HamtNode>& node, size_t hash, const Key& key, const Json& value, unsigned shift, bool in_place, bool& added)
+{
+  make_writable(node, in_place);
+  std::vector<HamtNode::Slot>& slots = node->slots;
+
+  if (shift >= hamt_hash_bits)
+  {
+    for (HamtNode::Slot& slot : slots)
+    {
+      if (slot.key == key)
+      {
+        slot.value = value;
+        return;
+      }
+    }
+
+    slots.push_back(HamtNode::Slot{ Ref<HamtNode>(), hash, key, value });
+    added = true;
+    return;
+  }
+
+  const uint32_t bit = uint32_t(1) << ((hash >> shift) & 31);
+  const int index = popcount(node->bitmap & (bit - 1));
+
+  if (!(node->bitmap & bit))
+  {
+    slots.insert(slots.begin() + index, HamtNode::Slot{ Ref<HamtNode>(), hash, key, value });
+    node->bitmap |= bit;
+    added = true;
+    return;
+  }
+
+  HamtNode::Slot& slot = slots[index];
+
+  if (slot.child)
+  {
+    hamt_set(slot.child, hash, key, value, shift + hamt_bits, in_place, added);
+  }
+  else if (slot.hash == hash && slot.key == key)
+  {
+    slot.value = value;
+  }
+  else
+  {
+    // the field is moved into a new child node
+    Ref<HamtNode> child;
+    bool ignored = false;
+    hamt_set(child, slot.hash, slot.key, slot.value, shift + hamt_bits, true, ignored);
+    hamt_set(child, hash, key, value, shift + hamt_bits, true, added);
+    slot.child = std::move(child);
+    slot.key = Key();
+    slot.value = nullptr;
+  }
+}
+
+// Removes `key`, which must be in the trie; `node` is reset if it
+// becomes empty.
+inline void hamt_erase(Ref<HamtNode>& node, size_t hash, StringView key, unsigned shift)
+{
+  make_writable(node, false);
+  std::vector<HamtNode::Slot>& slots = node->slots;
+  size_t index = 0;
+
+  if (shift >= hamt_hash_bits)
+  {
+    while (slots[index].key.view() != key)
+      ++index;
+  }
+  else
+  {
+    const uint32_t bit = uint32_t(1) << ((hash >> shift) & 31);
+    index = popcount(node->bitmap & (bit - 1));
+    HamtNode::Slot& slot = slots[index];
+
+    if (slot.child)
+    {
+      hamt_erase(slot.child, hash, key, shift + hamt_bits);
+
+      if (slot.child)
+      {
+        const HamtNode& child = *slot.child;
+
+        // a child with a single field is replaced by the field
+        if (child.slots.size() == 1 && !child.slots.front().child)
+        {
+          HamtNode::Slot field = child.slots.front();
+          slot = std::move(field);
+        }
+
+        return;
+      }
+    }
+
+    node->bitmap &= ~bit;
+  }
+
+  slots.erase(slots.begin() + index);
+
+  if (slots.empty())
+    node = Ref<HamtNode>();
+}
+
+template<typename F>
+void hamt_for_each(const HamtNode* node, F& f)
+{
+  if (node == nullptr)
+    return;
+
+  for (const HamtNode::Slot& slot : node->slots)
+  {
+    if (slot.child)
+      hamt_for_each(slot.child.get(), f);
+    else
+      f(slot.key, slot.value);
+  }
+}
+
+/*
+ * Node of a persistent vector; leaves store values, the other nodes
+ * store up to 32 children.
+ */
+struct VectorNode
+{
+  std::atomic<int> ref_count;
+  std::vector<Ref<VectorNode>> children;
+  std::vector<Json> values;
+
+  VectorNode() : ref_count(0) { }
+  VectorNode(const VectorNode& other) : ref_count(0), children(other.children), values(other.values) { }
+};
+
+static const unsigned vector_bits = 5;
+static const size_t vector_width = 32;
+static const size_t vector_mask = vector_width - 1;
+
+} // namespace details
+
+/*
+ * An immutable object whose modified versions share most of their
+ * memory with the original (a hash array mapped trie).
+ *
+ * Inserting or erasing a field costs O(log n) and returns a new object;
+ * the fields are iterated in an order that depends on the hash of the keys.
+ * The values are frozen (see Json::freeze()) as they are shared by all
+ * the versions of the object.
+ */
+class PersistentObject
+{
+public:
+  PersistentObject() : m_size(0) { }
+
+  // Creates an object with the fields of `object`.
+  explicit PersistentObject(const Json& object)
+    : m_size(0)
+  {
+    if (!object.isObject())
+      return;
+
+    for (const auto& f : JsonView(object).fields())
+    {
+      Json value = f.second;
+      value.freeze();
+      set(f.first, value, true);
+    }
+  }
+
+  inline size_t size() const { return m_size; }
+  inline bool empty() const { return m_size == 0; }
+
+  const Json* find(StringView key) const
+  {
+    return details::hamt_find(m_root.get(), details::hamt_hash(key), key);
+  }
+
+  inline bool contains(StringView key) const { return find(key) != nullptr; }
+
+  // Returns a null value if there is no field named `key`.
+  const Json& operator[](StringView key) const
+  {
+    const Json* value = find(key);
+    return value ? *value : null;
+  }
+
+  // Returns a copy of the object where the field `key` is set to `value`.
+  PersistentObject insert(Key key, Json value) const
+  {
+    value.freeze();
+    PersistentObject result = *this;
+    result.set(key, value, false);
+    return result;
+  }
+
+  // Returns a copy of the object without the field `key`.
+  PersistentObject erase(StringView key) const
+  {
+    if (!contains(key))
+      return *this;
+
+    PersistentObject result = *this;
+    details::hamt_erase(result.m_root, details::hamt_hash(key), key, 0);
+    result.m_size -= 1;
+    return result;
+  }
+
+  // Calls `f(const Key&, const Json&)` for each field.
+  template<typename F>
+  void forEach(F&& f) const
+  {
+    details::hamt_for_each(m_root.get(), f);
+  }
+
+  Json toJson() const
+  {
+    Object result;
+    result.data().reserve(m_size);
+
+    forEach([&result](const Key& key, const Json& value) {
+      result.data().emplace(key, value);
+    });
+
+    return result;
+  }
+
+protected:
+  void set(const Key& key, const Json& value, bool in_place)
+  {
+    bool added = false;
+    details::hamt_set(m_root, details::hamt_hash(key), key, value, 0, in_place, added);
+    m_size += added ? 1 : 0;
+  }
+
+private:
+  details::Ref<details::HamtNode> m_root;
+  size_t m_size;
+};
+
+/*
+ * An immutable array whose modified versions share most of their
+ * memory with the original (a radix-balanced tree of 32-wide nodes,
+ * whose last leaf is kept apart).
+ *
+ * Reading, setting or appending an element costs O(log n); appending
+ * and setting return a new array.
+ * The values are frozen (see Json::freeze()) as they are shared by all
+ * the versions of the array.
+ */
+class PersistentArray
+{
+public:
+  PersistentArray()
+    : m_size(0),
+      m_shift(details::vector_bits),
+      m_root(new details::VectorNode())
+  {
+
+  }
+
+  // Creates an array with the elements of `array`.
+  explicit PersistentArray(const Json& array)
+    : PersistentArray()
+  {
+    if (!array.isArray())
+      return;
+
+    for (int i(0); i < array.length(); ++i)
+    {
+      Json value = array.at(i);
+      value.freeze();
+      append(value, true);
+    }
+  }
+
+  inline int length() const { return static_cast<int>(m_size); }
+  inline bool empty() const { return m_size == 0; }
+
+  const Json& at(int index) const
+  {
+    return leaf(index).values[index & details::vector_mask];
+  }
+
+  inline const Json& operator[](int index) const { return at(index); }
+
+  // Returns a copy of the array where the element at `index` is `value`.
+  PersistentArray set(int index, Json value) const
+  {
+    value.freeze();
+    PersistentArray result = *this;
+
+    if (static_cast<size_t>(index) >= tailOffset())
+    {
+      details::make_writable(result.m_tail, false);
+      result.m_tail->values[index & details::vector_mask] = value;
+    }
+    else
+    {
+      assign(result.m_root, m_shift, index, value);
+    }
+
+    return result;
+  }
+
+  // Returns a copy of the array with `value` appended.
+  PersistentArray push(Json value) const
+  {
+    value.freeze();
+    PersistentArray result = *this;
+    result.append(value, false);
+    return result;
+  }
+
+  // Calls `f(const Json&)` for each element.
+  template<typename F>
+  void forEach(F&& f) const
+  {
+    for (size_t i(0); i < m_size; i += details::vector_width)
+    {
+      for (const Json& e : leaf(static_cast<int>(i)).values)
+        f(e);
+    }
+  }
+
+  Json toJson() const
+  {
+    Array result;
+    result.data().reserve(m_size);
+
+    forEach([&result](const Json& e) {
+      result.data().push_back(e);
+    });
+
+    return result;
+  }
+
+protected:
+  // Returns the index of the first element of the tail.
+  size_t tailOffset() const
+  {
+    return m_size < details::vector_width ? 0 : ((m_size - 1) >> details::vector_bits) << details::vector_bits;
+  }
+
+  // Returns the leaf that contains the element at `index`.
+  const details::VectorNode& leaf(int index) const
+  {
+    const size_t i = static_cast<size_t>(index);
+
+    if (i >= tailOffset())
+      return *m_tail;
+
+    const details::VectorNode* node = m_root.get();
+
+    for (unsigned level = m_shift; level > 0; level -= details::vector_bits)
+      node = node->children[(i >> level) & details::vector_mask].get();
+
+    return *node;
+  }
+
+  static void assign(details::Ref<details::VectorNode>& node, unsigned level, size_t index, const Json& value)
+  {
+    details::make_writable(node, false);
+
+    if (level == 0)
+      node->values[index & details::vector_mask] = value;
+    else
+      assign(node->children[(index >> level) & details::vector_mask], level - details::vector_bits, index, value);
+  }
+
+  // Returns a path of nodes from `level` to `leaf`.
+  static details::Ref<details::VectorNode> newPath(unsigned level, const details::Ref<details::VectorNode>& leaf)
+  {
+    if (level == 0)
+      return leaf;
+
+    details::Ref<details::VectorNode> result{ new details::VectorNode() };
+    result->children.push_back(newPath(level - details::vector_bits, leaf));
+    return result;
+  }
+
+  // Inserts the full tail in the tree.
+  void pushTail(details::Ref<details::VectorNode>& node, unsigned level, bool in_place)
+  {
+    details::make_writable(node, in_place);
+    const size_t index = ((m_size - 1) >> level) & details::vector_mask;
+
+    if (level == details::vector_bits)
+    {
+      node->children.push_back(m_tail);
+    }
+    else if (index < node->children.size())
+    {
+      pushTail(node->children[index], level - details::vector_bits, in_place);
+    }
+    else
+    {
+      node->children.push_back(newPath(level - details::vector_bits, m_tail));
+    }
+  }
+
+  void append(const Json& value, bool in_place)
+  {
+    if (m_size - tailOffset() < details::vector_width)
+    {
+      details::make_writable(m_tail, in_place);
+      m_tail->values.push_back(value);
+      m_size += 1;
+      return;
+    }
+
+    if ((m_size >> details::vector_bits) > (size_t(1) << m_shift))
+    {
+      // the tree is full, a level is added
+      details::Ref<details::VectorNode> root{ new details::VectorNode() };
+      root->children.push_back(m_root);
+      root->children.push_back(newPath(m_shift, m_tail));
+      m_root = root;
+      m_shift += details::vector_bits;
+    }
+    else
+    {
+      pushTail(m_root, m_shift, in_place);
+    }
+
+    m_tail = details::Ref<details::VectorNode>(new details::VectorNode());
+    m_tail->values.reserve(details::vector_width);
+    m_tail->values.push_back(value);
+    m_size += 1;
+  }
+
+private:
+  size_t m_size;
+  unsigned m_shift;
+  details::Ref<details::VectorNode> m_root;
+  details::Ref<details::VectorNode> m_tail;
+};
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_PERSISTENT_H
@@ -81,6 +81,40 @@ public:
   virtual Json encode(Serializer& serializer, void* value) = 0;
 };
 
+namespace details
+{
+
+/*
+ * Returns the visited value (see visit()) if it is a T.
+ */
+template<typename T>
+struct ScalarDecoder
+{
+  T operator()(const T& val) const { return val; }
+
+  template<typename U>
+  T operator()(const U&) const
+  {
+    throw std::runtime_error{ "Serializer::decode() : decode error - unexpected type" };
+  }
+};
+
+// Integers are also decoded as numbers.
+template<>
+struct ScalarDecoder<double>
+{
+  double operator()(double val) const { return val; }
+  double operator()(int val) const { return val; }
+
+  template<typename U>
+  double operator()(const U&) const
+  {
+    throw std::runtime_error{ "Serializer::decode() : decode error - not a number" };
+  }
+};
+
+} // namespace details
+
 namespace serialization
 {
 
@@ -89,7 +123,7 @@ struct decoder<bool>
 {
   static void decode(Serializer& s, const Json& data, bool& value)
   {
-    value = data.toBool();
+    value = visit(details::ScalarDecoder<bool>(), data);
   }
 };
 
@@ -98,7 +132,7 @@ struct decoder<int>
 {
   static void decode(Serializer& s, const Json& data, int& value)
   {
-    value = data.toInt();
+    value = visit(details::ScalarDecoder<int>(), data);
   }
 };
 
@@ -107,7 +141,7 @@ struct decoder<std::string>
 {
   static void decode(Serializer& s, const Json& data, std::string& value)
   {
-    value = data.toString();
+    value = visit(details::ScalarDecoder<std::string>(), data);
   }
 };
 
@@ -116,7 +150,7 @@ struct decoder<double>
 {
   static void decode(Serializer& s, const Json& data, double& value)
   {
-    value = data.toNumber();
+    value = visit(details::ScalarDecoder<double>(), data);
   }
 };
 
@@ -219,7 +253,13 @@ struct decoder<std::variant<Args...>>
 {
   static void decode(Serializer& s, const Json& data, std::variant<Args...>& value)
   {
-    variant_decoder<std::variant<Args...>, 0>::decode(s, data["index"].toInt(), data["value"], value);
+    const Json* index = data.find("index");
+    const Json* alternative = data.find("value");
+
+    if (!index || !alternative)
+      throw std::runtime_error{ "Could not decode variant" };
+
+    variant_decoder<std::variant<Args...>, 0>::decode(s, index->toInt(), *alternative, value);
   }
 };
 
@@ -416,16 +456,16 @@ public:
     {
       details::ObjectField* field = it->second.get();
 
-      Json field_data = data[field->member_name_];
+      const Json* field_data = data.find(field->member_name_);
 
-      if (field_data.isNull())
+      if (!field_data || field_data->isNull())
       {
         if (!field->optional_)
           throw std::runtime_error{ "Missing required field" };
       }
       else
       {
-        field->decode_field(serializer, data, field_data, value);
+        field->decode_field(serializer, data, *field_data, value);
       }
     }
   }
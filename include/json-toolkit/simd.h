@@ -0,0 +1,370 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_SIMD_H
+#define JSONTOOLKIT_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// SIMD code paths can be disabled by defining JSONTOOLKIT_NO_SIMD.
+#if !defined(JSONTOOLKIT_NO_SIMD)
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define JSONTOOLKIT_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define JSONTOOLKIT_AVX2
+#define JSONTOOLKIT_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#define JSONTOOLKIT_AVX2
+#define JSONTOOLKIT_TARGET_AVX2
+#include <immintrin.h>
+#endif
+#endif
+#endif // !defined(JSONTOOLKIT_NO_SIMD)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace json
+{
+
+enum class SimdLevel
+{
+  Scalar = 0,
+  SSE2,
+  AVX2,
+};
+
+namespace details
+{
+
+inline int trailing_zeros(uint64_t x)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+inline uint64_t prefix_xor(uint64_t x)
+{
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+/*
+ * Characters of interest in a block of 64 bytes, one bit per byte.
+ */
+struct BlockMasks
+{
+  uint64_t quote;
+  uint64_t single_quote;
+  uint64_t backslash;
+  uint64_t op;
+  uint64_t space;
+  uint64_t newline;
+};
+
+static const size_t block_size = 64;
+
+enum CharClass {
+  ClassQuote = 1,
+  ClassSingleQuote = 2,
+  ClassBackslash = 4,
+  ClassOp = 8,
+  ClassSpace = 16,
+  ClassNewLine = 32,
+};
+
+inline unsigned char char_class(unsigned char c)
+{
+  switch (c)
+  {
+  case '"': return ClassQuote;
+  case '\'': return ClassSingleQuote;
+  case '\\': return ClassBackslash;
+  case '{':
+  case '}':
+  case '[':
+  case ']':
+  case ':':
+  case ',':
+    return ClassOp;
+  case ' ': return ClassSpace;
+  case '\n': return ClassNewLine;
+  default:
+    return 0;
+  }
+}
+
+inline void classify_scalar(const char* block, BlockMasks& masks)
+{
+  masks = BlockMasks{ 0, 0, 0, 0, 0, 0 };
+
+  for (size_t i(0); i < block_size; ++i)
+  {
+    const unsigned char cc = char_class(static_cast<unsigned char>(block[i]));
+
+    if (cc == 0)
+      continue;
+
+    const uint64_t bit = uint64_t(1) << i;
+    masks.quote |= (cc & ClassQuote) ? bit : 0;
+    masks.single_quote |= (cc & ClassSingleQuote) ? bit : 0;
+    masks.backslash |= (cc & ClassBackslash) ? bit : 0;
+    masks.op |= (cc & ClassOp) ? bit : 0;
+    masks.space |= (cc & ClassSpace) ? bit : 0;
+    masks.newline |= (cc & ClassNewLine) ? bit : 0;
+  }
+}
+
+#if defined(JSONTOOLKIT_SSE2)
+
+inline uint64_t sse2_mask(__m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+  return uint64_t(uint16_t(_mm_movemask_epi8(m0)))
+    | (uint64_t(uint16_t(_mm_movemask_epi8(m1))) << 16)
+    | (uint64_t(uint16_t(_mm_movemask_epi8(m2))) << 32)
+    | (uint64_t(uint16_t(_mm_movemask_epi8(m3))) << 48);
+}
+
+inline __m128i sse2_op(__m128i chunk)
+{
+  __m128i r = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('{'));
+  r = _mm_or_si128(r, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('}')));
+  r = _mm_or_si128(r, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('[')));
+  r = _mm_or_si128(r, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(']')));
+  r = _mm_or_si128(r, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(':')));
+  return _mm_or_si128(r, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(',')));
+}
+
+inline uint64_t sse2_eq(const __m128i* chunks, char c)
+{
+  const __m128i v = _mm_set1_epi8(c);
+  return sse2_mask(_mm_cmpeq_epi8(chunks[0], v), _mm_cmpeq_epi8(chunks[1], v),
+    _mm_cmpeq_epi8(chunks[2], v), _mm_cmpeq_epi8(chunks[3], v));
+}
+
+inline void classify_sse2(const char* block, BlockMasks& masks)
+{
+  __m128i chunks[4];
+
+  for (int i(0); i < 4; ++i)
+    chunks[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+
+  masks.quote = sse2_eq(chunks, '"');
+  masks.single_quote = sse2_eq(chunks, '\'');
+  masks.backslash = sse2_eq(chunks, '\\');
+  masks.op = sse2_mask(sse2_op(chunks[0]), sse2_op(chunks[1]), sse2_op(chunks[2]), sse2_op(chunks[3]));
+  masks.space = sse2_eq(chunks, ' ');
+  masks.newline = sse2_eq(chunks, '\n');
+}
+
+#endif // defined(JSONTOOLKIT_SSE2)
+
+#if defined(JSONTOOLKIT_AVX2)
+
+JSONTOOLKIT_TARGET_AVX2 inline uint64_t avx2_mask(__m256i m0, __m256i m1)
+{
+  return uint64_t(uint32_t(_mm256_movemask_epi8(m0))) | (uint64_t(uint32_t(_mm256_movemask_epi8(m1))) << 32);
+}
+
+JSONTOOLKIT_TARGET_AVX2 inline __m256i avx2_op(__m256i chunk)
+{
+  __m256i r = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('{'));
+  r = _mm256_or_si256(r, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('}')));
+  r = _mm256_or_si256(r, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('[')));
+  r = _mm256_or_si256(r, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(']')));
+  r = _mm256_or_si256(r, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(':')));
+  return _mm256_or_si256(r, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(',')));
+}
+
+JSONTOOLKIT_TARGET_AVX2 inline uint64_t avx2_eq(__m256i lo, __m256i hi, char c)
+{
+  const __m256i v = _mm256_set1_epi8(c);
+  return avx2_mask(_mm256_cmpeq_epi8(lo, v), _mm256_cmpeq_epi8(hi, v));
+}
+
+JSONTOOLKIT_TARGET_AVX2 inline void classify_avx2(const char* block, BlockMasks& masks)
+{
+  const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+  const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+
+  masks.quote = avx2_eq(lo, hi, '"');
+  masks.single_quote = avx2_eq(lo, hi, '\'');
+  masks.backslash = avx2_eq(lo, hi, '\\');
+  masks.op = avx2_mask(avx2_op(lo), avx2_op(hi));
+  masks.space = avx2_eq(lo, hi, ' ');
+  masks.newline = avx2_eq(lo, hi, '\n');
+}
+
+inline bool cpu_supports_avx2()
+{
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+
+  if (info[0] < 7)
+    return false;
+
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+
+  if (!osxsave || (_xgetbv(0) & 6) != 6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // defined(JSONTOOLKIT_AVX2)
+
+inline SimdLevel detect_simd_level()
+{
+#if defined(JSONTOOLKIT_AVX2)
+  if (cpu_supports_avx2())
+    return SimdLevel::AVX2;
+#endif
+
+#if defined(JSONTOOLKIT_SSE2)
+  return SimdLevel::SSE2;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+typedef void(*ClassifyFunction)(const char*, BlockMasks&);
+
+inline ClassifyFunction classify_function(SimdLevel level)
+{
+  switch (level)
+  {
+#if defined(JSONTOOLKIT_AVX2)
+  case SimdLevel::AVX2:
+    return classify_avx2;
+#endif
+#if defined(JSONTOOLKIT_SSE2)
+  case SimdLevel::SSE2:
+    return classify_sse2;
+#endif
+  default:
+    return classify_scalar;
+  }
+}
+
+// Returns the first occurrence of `quote`, of a backslash or of a new line
+// in [begin, end), or `end` if there is none.
+inline const char* find_string_delimiter(const char* begin, const char* end, char quote)
+{
+#if defined(JSONTOOLKIT_SSE2)
+  const __m128i q = _mm_set1_epi8(quote);
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i newline = _mm_set1_epi8('\n');
+
+  for (; end - begin >= 16; begin += 16)
+  {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(chunk, q), _mm_cmpeq_epi8(chunk, backslash));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(chunk, newline));
+    const int bits = _mm_movemask_epi8(m);
+
+    if (bits)
+      return begin + trailing_zeros(static_cast<uint64_t>(bits));
+  }
+#endif // defined(JSONTOOLKIT_SSE2)
+
+  for (; begin != end; ++begin)
+  {
+    if (*begin == quote || *begin == '\\' || *begin == '\n')
+      return begin;
+  }
+
+  return end;
+}
+
+template<bool AsciiOnly>
+inline bool must_escape(char c)
+{
+  const unsigned char u = static_cast<unsigned char>(c);
+  return u < 0x20 || c == '"' || c == '\\' || (AsciiOnly && u >= 0x80);
+}
+
+#if defined(JSONTOOLKIT_SSE2)
+
+template<bool AsciiOnly>
+inline uint32_t sse2_escaped(const char* chunk_data)
+{
+  const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk_data));
+  const __m128i m = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\')));
+
+  // the signed comparison also matches the bytes above 0x7F
+  const __m128i control = AsciiOnly ? _mm_cmplt_epi8(chunk, _mm_set1_epi8(0x20))
+    : _mm_cmpeq_epi8(_mm_max_epu8(chunk, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F));
+
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(m, control)));
+}
+
+#endif // defined(JSONTOOLKIT_SSE2)
+
+// Returns the first character of [begin, end) that must be escaped in a 
+// Json string (a quote, a backslash, a control character and, if 
+// `AsciiOnly`, a non-ASCII byte), or `end` if there is none.
+template<bool AsciiOnly>
+inline const char* find_escaped(const char* begin, const char* end)
+{
+#if defined(JSONTOOLKIT_SSE2)
+  for (; end - begin >= 32; begin += 32)
+  {
+    const uint32_t bits = sse2_escaped<AsciiOnly>(begin) | (sse2_escaped<AsciiOnly>(begin + 16) << 16);
+
+    if (bits)
+      return begin + trailing_zeros(bits);
+  }
+
+  if (end - begin >= 16)
+  {
+    const uint32_t bits = sse2_escaped<AsciiOnly>(begin);
+
+    if (bits)
+      return begin + trailing_zeros(bits);
+
+    begin += 16;
+  }
+#endif // defined(JSONTOOLKIT_SSE2)
+
+  for (; begin != end; ++begin)
+  {
+    if (must_escape<AsciiOnly>(*begin))
+      return begin;
+  }
+
+  return end;
+}
+
+} // namespace details
+
+// Returns the best instruction set available on the running CPU.
+inline SimdLevel simd_level()
+{
+  static const SimdLevel level = details::detect_simd_level();
+  return level;
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_SIMD_H
@@ -0,0 +1,275 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_SNAPSHOT_H
+#define JSONTOOLKIT_SNAPSHOT_H
+
+#include "json-toolkit/json.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace json
+{
+
+namespace details
+{
+
+/*
+ * The epoch announced by a thread while it reads a snapshot, 0 when
+ * the thread is not reading.
+ */
+struct EpochRecord
+{
+  std::atomic<uint64_t> epoch;
+  std::atomic<bool> in_use;
+  EpochRecord* next;
+  // Number of nested reads, only accessed by the owning thread.
+  unsigned depth;
+  // Keeps the records of different threads on different cache lines.
+  char padding[64];
+
+  EpochRecord() : epoch(0), in_use(true), next(nullptr), depth(0) { }
+};
+
+/*
+ * Epoch-based reclamation shared by all the snapshots.
+ *
+ * A thread gets a record the first time it reads a snapshot; the record
+ * is given back when the thread exits and can then be reused by another
+ * thread. Records are never freed.
+ */
+class EpochDomain
+{
+public:
+  static EpochDomain& instance()
+  {
+    static EpochDomain domain;
+    return domain;
+  }
+
+  EpochRecord* acquireRecord()
+  {
+    for (EpochRecord* r = m_records.load(std::memory_order_acquire); r != nullptr; r = r->next)
+    {
+      bool expected = false;
+
+      if (!r->in_use.load(std::memory_order_relaxed) && r->in_use.compare_exchange_strong(expected, true))
+        return r;
+    }
+
+    EpochRecord* record = new EpochRecord();
+    record->next = m_records.load(std::memory_order_relaxed);
+
+    while (!m_records.compare_exchange_weak(record->next, record))
+      ;
+
+    return record;
+  }
+
+  void releaseRecord(EpochRecord* record)
+  {
+    record->epoch.store(0, std::memory_order_release);
+    record->in_use.store(false, std::memory_order_release);
+  }
+
+  inline uint64_t epoch() const { return m_epoch.load(); }
+
+  // Returns the epoch before the increment.
+  inline uint64_t advance() { return m_epoch.fetch_add(1); }
+
+  // Returns the oldest epoch announced by a reading thread; values that
+  // were retired before that epoch are not read anymore.
+  uint64_t oldestReader() const
+  {
+    uint64_t result = UINT64_MAX;
+
+    for (EpochRecord* r = m_records.load(std::memory_order_acquire); r != nullptr; r = r->next)
+    {
+      const uint64_t e = r->epoch.load();
+
+      if (e != 0 && e < result)
+        result = e;
+    }
+
+    return result;
+  }
+
+private:
+  EpochDomain() : m_epoch(1), m_records(nullptr) { }
+
+private:
+  std::atomic<uint64_t> m_epoch;
+  std::atomic<EpochRecord*> m_records;
+};
+
+struct ThreadEpochRecord
+{
+  EpochRecord* record;
+
+  ThreadEpochRecord() : record(EpochDomain::instance().acquireRecord()) { }
+  ~ThreadEpochRecord() { EpochDomain::instance().releaseRecord(record); }
+};
+
+inline EpochRecord* this_thread_record()
+{
+  static thread_local ThreadEpochRecord r;
+  return r.record;
+}
+
+} // namespace details
+
+/*
+ * A Json value that is read by many threads while being replaced.
+ *
+ * Reading does not lock and does not update any reference count that
+ * is shared with other threads: each thread only announces the epoch
+ * during which it reads. A replaced value is destroyed once no thread
+ * reads it anymore.
+ * Published values are frozen (see Json::freeze()); they should be read
+ * with a JsonView, as copying a Json updates its reference count.
+ */
+class AtomicSnapshot
+{
+public:
+  /*
+   * Keeps the value that was current when it was created alive.
+   * A Reader must be destroyed by the thread that created it.
+   */
+  class Reader
+  {
+  public:
+    Reader(const Reader&) = delete;
+
+    Reader(Reader&& other)
+      : m_record(other.m_record),
+        m_value(other.m_value)
+    {
+      other.m_record = nullptr;
+    }
+
+    ~Reader()
+    {
+      if (m_record && --m_record->depth == 0)
+        m_record->epoch.store(0, std::memory_order_release);
+    }
+
+    inline const Json& operator*() const { return *m_value; }
+    inline const Json* operator->() const { return m_value; }
+    inline JsonView view() const { return JsonView(*m_value); }
+
+    Reader& operator=(const Reader&) = delete;
+
+  protected:
+    friend class AtomicSnapshot;
+
+    Reader(details::EpochRecord* record, const Json* value)
+      : m_record(record),
+        m_value(value)
+    {
+
+    }
+
+  private:
+    details::EpochRecord* m_record;
+    const Json* m_value;
+  };
+
+  explicit AtomicSnapshot(Json value = nullptr)
+  {
+    value.freeze();
+    m_current.store(new Json(std::move(value)));
+  }
+
+  AtomicSnapshot(const AtomicSnapshot&) = delete;
+
+  // No thread must be reading the snapshot.
+  ~AtomicSnapshot()
+  {
+    delete m_current.load();
+
+    for (const Retired& r : m_retired)
+      delete r.value;
+  }
+
+  Reader read() const
+  {
+    details::EpochRecord* record = details::this_thread_record();
+
+    if (record->depth++ == 0)
+      record->epoch.store(details::EpochDomain::instance().epoch());
+
+    return Reader(record, m_current.load());
+  }
+
+  // Returns a copy of the current value, that can be kept as long as needed.
+  Json load() const
+  {
+    return *read();
+  }
+
+  // Replaces the current value; the previous value is destroyed when the
+  // threads that read it are done.
+  void publish(Json value)
+  {
+    value.freeze();
+    Json* next = new Json(std::move(value));
+
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    Json* previous = m_current.exchange(next);
+    m_retired.push_back(Retired{ previous, details::EpochDomain::instance().advance() });
+    reclaim();
+  }
+
+  // Destroys the replaced values that are not read anymore; this is also
+  // done by publish().
+  void collect()
+  {
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    reclaim();
+  }
+
+  // Returns the number of replaced values that are not destroyed yet.
+  size_t pending() const
+  {
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    return m_retired.size();
+  }
+
+  AtomicSnapshot& operator=(const AtomicSnapshot&) = delete;
+
+protected:
+  struct Retired
+  {
+    Json* value;
+    uint64_t epoch;
+  };
+
+  void reclaim()
+  {
+    const uint64_t oldest = details::EpochDomain::instance().oldestReader();
+    size_t kept = 0;
+
+    for (const Retired& r : m_retired)
+    {
+      if (r.epoch < oldest)
+        delete r.value;
+      else
+        m_retired[kept++] = r;
+    }
+
+    m_retired.resize(kept);
+  }
+
+private:
+  std::atomic<Json*> m_current;
+  mutable std::mutex m_mutex;
+  std::vector<Retired> m_retired;
+};
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_SNAPSHOT_H
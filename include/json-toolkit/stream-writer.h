@@ -0,0 +1,326 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_STREAM_WRITER_H
+#define JSONTOOLKIT_STREAM_WRITER_H
+
+#include "json-toolkit/stringify.h"
+
+#include <cstdio>
+#include <ostream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define JSONTOOLKIT_POSIX
+#include <cerrno>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace json
+{
+
+/*
+struct Sink
+{
+  void write(const char* data, size_t size);
+  // Writes [first, first + first_size) then [second, second + second_size).
+  void write(const char* first, size_t first_size, const char* second, size_t second_size);
+};
+*/
+
+#if defined(JSONTOOLKIT_POSIX)
+
+/*
+ * Sink writing to a POSIX file descriptor, which is not closed.
+ */
+class FileDescriptorSink
+{
+public:
+  explicit FileDescriptorSink(int fd) : m_fd(fd) { }
+
+  inline int fd() const { return m_fd; }
+
+  void write(const char* data, size_t size)
+  {
+    write(data, size, nullptr, 0);
+  }
+
+  // Both ranges are written with a single writev() call when possible.
+  void write(const char* first, size_t first_size, const char* second, size_t second_size)
+  {
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(first);
+    iov[0].iov_len = first_size;
+    iov[1].iov_base = const_cast<char*>(second);
+    iov[1].iov_len = second_size;
+
+    struct iovec* it = iov;
+    int count = second_size > 0 ? 2 : 1;
+
+    while (count > 0)
+    {
+      const ssize_t n = ::writev(m_fd, it, count);
+
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+
+        throw std::runtime_error{ "Could not write to file descriptor" };
+      }
+
+      size_t written = static_cast<size_t>(n);
+
+      while (count > 0 && written >= it->iov_len)
+      {
+        written -= it->iov_len;
+        ++it;
+        --count;
+      }
+
+      if (count > 0)
+      {
+        it->iov_base = static_cast<char*>(it->iov_base) + written;
+        it->iov_len -= written;
+      }
+    }
+  }
+
+private:
+  int m_fd;
+};
+
+#endif // defined(JSONTOOLKIT_POSIX)
+
+/*
+ * Sink writing to a FILE*, which is neither flushed nor closed.
+ */
+class FileSink
+{
+public:
+  explicit FileSink(std::FILE* file) : m_file(file) { }
+
+  inline std::FILE* file() const { return m_file; }
+
+  void write(const char* data, size_t size)
+  {
+    if (std::fwrite(data, 1, size, m_file) != size)
+      throw std::runtime_error{ "Could not write to file" };
+  }
+
+  void write(const char* first, size_t first_size, const char* second, size_t second_size)
+  {
+    write(first, first_size);
+    write(second, second_size);
+  }
+
+private:
+  std::FILE* m_file;
+};
+
+/*
+ * Sink writing to a std::ostream, which is not flushed.
+ */
+class OStreamSink
+{
+public:
+  explicit OStreamSink(std::ostream& stream) : m_stream(&stream) { }
+
+  inline std::ostream& stream() const { return *m_stream; }
+
+  void write(const char* data, size_t size)
+  {
+    if (!m_stream->write(data, static_cast<std::streamsize>(size)))
+      throw std::runtime_error{ "Could not write to stream" };
+  }
+
+  void write(const char* first, size_t first_size, const char* second, size_t second_size)
+  {
+    write(first, first_size);
+    write(second, second_size);
+  }
+
+private:
+  std::ostream* m_stream;
+};
+
+/*
+ * Writer backend that writes the output to a Sink through a buffer of
+ * fixed size, so that memory usage does not depend on the size of the
+ * output.
+ *
+ * The runs of a string that need no escaping and do not fit in the
+ * buffer are written to the sink directly, along with the buffer.
+ * flush() must be called once the value is written.
+ */
+template<typename Sink>
+class StreamWriterBackend
+{
+public:
+  static const size_t default_capacity = 64 * 1024;
+
+  explicit StreamWriterBackend(Sink sink, size_t capacity = default_capacity)
+    : m_sink(sink),
+      m_capacity(capacity)
+  {
+    // tokens are written before the buffer is flushed
+    m_output.buffer().reserve(capacity + 64);
+  }
+
+  inline Sink& sink() { return m_sink; }
+  inline size_t capacity() const { return m_capacity; }
+
+  inline bool asciiOnly() const { return m_output.asciiOnly(); }
+  inline void setAsciiOnly(bool on) { m_output.setAsciiOnly(on); }
+
+  // Writes the content of the buffer to the sink.
+  void flush()
+  {
+    std::string& buffer = m_output.buffer();
+
+    if (!buffer.empty())
+      m_sink.write(buffer.data(), buffer.size());
+
+    buffer.clear();
+  }
+
+  StreamWriterBackend& operator<<(CharCategory c)
+  {
+    m_output << c;
+    return written();
+  }
+
+  StreamWriterBackend& operator<<(Indentation indent)
+  {
+    m_output << indent;
+    return written();
+  }
+
+  StreamWriterBackend& operator<<(std::nullptr_t)
+  {
+    m_output << nullptr;
+    return written();
+  }
+
+  StreamWriterBackend& operator<<(bool value)
+  {
+    m_output << value;
+    return written();
+  }
+
+  StreamWriterBackend& operator<<(int value)
+  {
+    m_output << value;
+    return written();
+  }
+
+  StreamWriterBackend& operator<<(double value)
+  {
+    m_output << value;
+    return written();
+  }
+
+  StreamWriterBackend& operator<<(StringView str)
+  {
+    if (asciiOnly())
+      writeEscaped<true>(str);
+    else
+      writeEscaped<false>(str);
+
+    return written();
+  }
+
+protected:
+  StreamWriterBackend& written()
+  {
+    if (m_output.buffer().size() >= m_capacity)
+      flush();
+
+    return *this;
+  }
+
+  template<bool AsciiOnly>
+  void writeEscaped(StringView str)
+  {
+    std::string& buffer = m_output.buffer();
+    const char* it = str.begin();
+
+    for (;;)
+    {
+      const char* next = details::find_escaped<AsciiOnly>(it, str.end());
+      const size_t run = static_cast<size_t>(next - it);
+
+      if (buffer.size() + run <= m_capacity)
+      {
+        buffer.append(it, next);
+      }
+      else if (run < m_capacity)
+      {
+        flush();
+        buffer.append(it, next);
+      }
+      else
+      {
+        m_sink.write(buffer.data(), buffer.size(), it, run);
+        buffer.clear();
+      }
+
+      if (next == str.end())
+        return;
+
+      it = details::append_escape(buffer, next, str.end());
+
+      if (buffer.size() >= m_capacity)
+        flush();
+    }
+  }
+
+private:
+  Sink m_sink;
+  size_t m_capacity;
+  DefaultWriterBackend m_output;
+};
+
+template<typename Sink>
+const size_t StreamWriterBackend<Sink>::default_capacity;
+
+namespace details
+{
+
+template<typename Sink, typename Format>
+inline void stringify_to(Sink& sink, JsonView data, const Format& format, StringifyOptions options)
+{
+  GenericWriter<StreamWriterBackend<Sink&>, Format> writer{ format, StreamWriterBackend<Sink&>(sink) };
+  writer.backend().setAsciiOnly((options & AsciiOnly) != 0);
+  write(writer, data);
+  writer.backend().flush();
+}
+
+} // namespace details
+
+/*
+ * Writes `data` to `sink` (a FileDescriptorSink, a FileSink, an
+ * OStreamSink or any class with the same write() functions) through
+ * a buffer of StreamWriterBackend::default_capacity bytes.
+ */
+template<typename Sink>
+inline void stringify_to(Sink&& sink, const Json& data, StringifyOptions options = None)
+{
+  if (options & Compact)
+    details::stringify_to(sink, data, CompactFormat(), options);
+  else
+    details::stringify_to(sink, data, PrettyFormat(), options);
+}
+
+// Writes `data` to `sink` with the given format, the Compact flag is ignored.
+template<typename Sink>
+inline void stringify_to(Sink&& sink, const Json& data, const PrettyFormat& format, StringifyOptions options = None)
+{
+  details::stringify_to(sink, data, format, options);
+}
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_STREAM_WRITER_H
@@ -10,10 +10,19 @@
 namespace json
 {
 
-enum StringifyOptions {
+enum StringifyOptions : int {
   None = 0,
+  // Writes no whitespace between tokens.
+  Compact = 1,
+  // Writes non-ASCII characters as \u escapes.
+  AsciiOnly = 2,
 };
 
+inline StringifyOptions operator|(StringifyOptions lhs, StringifyOptions rhs)
+{
+  return static_cast<StringifyOptions>(static_cast<int>(lhs) | static_cast<int>(rhs));
+}
+
 std::string stringify(const json::Json& data, StringifyOptions options = None);
 
 enum class WriterState
@@ -26,7 +35,50 @@ enum class WriterState
   WroteArrayValue,
 };
 
-template<typename Backend>
+/*
+ * Format of a GenericWriter that writes the fields of objects on their 
+ * own line, indented by `width` spaces per level, and a space after 
+ * commas and colons.
+ */
+struct PrettyFormat
+{
+  explicit PrettyFormat(size_t w = 2) : width(w) { }
+
+  template<typename Backend>
+  void separator(Backend& out) const { out << CharCategory::Comma << CharCategory::Space; }
+
+  template<typename Backend>
+  void colon(Backend& out) const { out << CharCategory::Colon << CharCategory::Space; }
+
+  template<typename Backend>
+  void newLine(Backend& out, size_t depth) const { out << CharCategory::NewLine << Indentation{ width * depth }; }
+
+  size_t width;
+};
+
+// Returns the format writing one field per line, indented by `width`
+// spaces per level (the default is 2); a negative width is read as 0.
+PrettyFormat indented(int width);
+
+// Writes `data` with the given format, the Compact flag is ignored.
+std::string stringify(const json::Json& data, const PrettyFormat& format, StringifyOptions options = None);
+
+/*
+ * Format of a GenericWriter that writes no whitespace.
+ */
+struct CompactFormat
+{
+  template<typename Backend>
+  void separator(Backend& out) const { out << CharCategory::Comma; }
+
+  template<typename Backend>
+  void colon(Backend& out) const { out << CharCategory::Colon; }
+
+  template<typename Backend>
+  void newLine(Backend&, size_t) const { }
+};
+
+template<typename Backend, typename Format = PrettyFormat>
 class GenericWriter
 {
 public:
@@ -37,10 +89,28 @@ public:
     m_states.push_back(WriterState::Idle);
   }
 
+  explicit GenericWriter(const Format& format)
+    : m_key_quotes(CharCategory::Invalid),
+    m_depth(0),
+    m_format(format)
+  {
+    m_states.push_back(WriterState::Idle);
+  }
+
+  GenericWriter(const Format& format, Backend&& backend)
+    : m_key_quotes(CharCategory::Invalid),
+    m_depth(0),
+    m_format(format),
+    m_backend(std::move(backend))
+  {
+    m_states.push_back(WriterState::Idle);
+  }
+
   inline WriterState state() const { return m_states.back(); }
   inline const std::vector<WriterState>& stack() const { return m_states; }
 
   inline Backend& backend() { return m_backend; }
+  inline const Format& format() const { return m_format; }
 
   void value(std::nullptr_t)
   {
@@ -86,24 +156,21 @@ public:
     enter(WriterState::StartedObject);
   }
 
-  void key(const std::string& str)
+  void key(StringView str)
   {
     if (state() == WriterState::WroteObjectValue)
     {
-      backend() << CharCategory::Comma << CharCategory::NewLine;
+      backend() << CharCategory::Comma;
     }
-    else if (state() == WriterState::StartedObject)
-    {
-      backend() << CharCategory::NewLine;
-    }
-    else
+    else if (state() != WriterState::StartedObject)
     {
       throw std::runtime_error{ "Invalid writer state" };
     }
 
-    indent();
+    newLine();
 
-    backend() << CharCategory::DoubleQuote <<  str << CharCategory::DoubleQuote  << CharCategory::Colon << CharCategory::Space;
+    backend() << CharCategory::DoubleQuote << str << CharCategory::DoubleQuote;
+    m_format.colon(backend());
 
     update(WriterState::WroteObjectKey);
   }
@@ -116,8 +183,7 @@ public:
     }
     else if (state() == WriterState::WroteObjectValue)
     {
-      backend() << CharCategory::NewLine;
-      indent(-1);
+      newLine(-1);
       backend() << CharCategory::RBrace;
     }
 
@@ -169,12 +235,9 @@ protected:
       update(WriterState::WroteArrayValue);
   }
 
-  void indent(int delta = 0)
+  void newLine(int delta = 0)
   {
-    for (size_t i(0); i < stack().size() - 1 + delta; ++i)
-    {
-      backend() << CharCategory::Space << CharCategory::Space;
-    }
+    m_format.newLine(backend(), stack().size() - 1 + delta);
   }
 
   // Update state after writing a value
@@ -190,13 +253,14 @@ protected:
   {
     if (state() == WriterState::WroteArrayValue)
     {
-      backend() << CharCategory::Comma << CharCategory::Space;
+      m_format.separator(backend());
     }
   }
 
 private:
   CharCategory m_key_quotes;
   int m_depth;
+  Format m_format;
   Backend m_backend;
   std::vector<WriterState> m_states;
 };
@@ -211,62 +275,94 @@ namespace json
 namespace details
 {
 
-inline void write(GenericWriter<DefaultWriterBackend>& writer, const json::Json& data)
+/*
+ * Writes the visited value (see visit()).
+ */
+template<typename Writer>
+class WriteVisitor
 {
-  if (data.isArray())
+public:
+  explicit WriteVisitor(Writer& writer) : m_writer(writer) { }
+
+  void operator()(std::nullptr_t) { m_writer.value(nullptr); }
+  void operator()(bool val) { m_writer.value(val); }
+  void operator()(int val) { m_writer.value(val); }
+  void operator()(double val) { m_writer.value(val); }
+  void operator()(const std::string& str) { m_writer.value(str); }
+
+  void operator()(ArrayView array)
   {
-    writer.start_array();
+    m_writer.start_array();
 
-    for (int i(0); i < data.length(); ++i)
+    if (!array.integers().empty())
     {
-      write(writer, data.at(i));
+      for (int val : array.integers())
+        m_writer.value(val);
+    }
+    else if (!array.numbers().empty())
+    {
+      for (double val : array.numbers())
+        m_writer.value(val);
+    }
+    else
+    {
+      for (int i(0); i < array.length(); ++i)
+        visit(*this, array.at(i));
     }
 
-    writer.end_array();
+    m_writer.end_array();
   }
-  else if (data.isObject())
-  {
-    writer.start_object();
 
-    Object obj = data.toObject();
+  void operator()(const ObjectStorage& fields)
+  {
+    m_writer.start_object();
 
-    for (const auto& e : obj.data())
+    for (const auto& e : fields)
     {
-      writer.key(e.first);
-      write(writer, e.second);
+      m_writer.key(e.first);
+      visit(*this, e.second);
     }
 
-    writer.end_object();
-  }
-  else if (data.isNull())
-  {
-    writer.value(nullptr);
-  }
-  else if (data.isBoolean())
-  {
-    writer.value(data.toBool());
-  }
-  else if (data.isInteger())
-  {
-    writer.value(data.toInt());
-  }
-  else if (data.isNumber())
-  {
-    writer.value(data.toNumber());
-  }
-  else if (data.isString())
-  {
-    writer.value(data.toString());
+    m_writer.end_object();
   }
+
+private:
+  Writer& m_writer;
+};
+
+template<typename Writer>
+inline void write(Writer& writer, JsonView data)
+{
+  visit(WriteVisitor<Writer>(writer), data);
+}
+
+template<typename Format>
+inline std::string stringify(JsonView data, const Format& format, StringifyOptions options)
+{
+  GenericWriter<DefaultWriterBackend, Format> writer{ format };
+  writer.backend().setAsciiOnly((options & AsciiOnly) != 0);
+  write(writer, data);
+  return writer.backend().result();
 }
 
 } // namespace details
 
+inline PrettyFormat indented(int width)
+{
+  return PrettyFormat(width > 0 ? static_cast<size_t>(width) : 0);
+}
+
 inline std::string stringify(const json::Json& data, StringifyOptions options)
 {
-  GenericWriter<DefaultWriterBackend> writer;
-  details::write(writer, data);
-  return writer.backend().result();
+  if (options & Compact)
+    return details::stringify(data, CompactFormat(), options);
+
+  return details::stringify(data, PrettyFormat(), options);
+}
+
+inline std::string stringify(const json::Json& data, const PrettyFormat& format, StringifyOptions options)
+{
+  return details::stringify(data, format, options);
 }
 
 } // namespace json
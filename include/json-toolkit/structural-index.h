@@ -0,0 +1,174 @@
+// Copyright (C) 2019 Vincent Chambrin
+// This file is part of the json-toolkit library
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifndef JSONTOOLKIT_STRUCTURAL_INDEX_H
+#define JSONTOOLKIT_STRUCTURAL_INDEX_H
+
+#include "json-toolkit/simd.h"
+
+#include <cstring>
+#include <vector>
+
+namespace json
+{
+
+/*
+ * Finds the position of the structural characters of a Json input,
+ * 64 bytes at a time.
+ *
+ * The index contains the brackets, braces, colons and commas that are
+ * not part of a string, the quotes delimiting double-quoted strings,
+ * the first character of numbers and identifiers and the single quotes
+ * that are not part of a double-quoted string.
+ * Backslashes and new lines inside strings are also reported so that
+ * strings that need to be rewritten can be detected.
+ *
+ * The input is indexed lazily by windows of a few kilobytes so that
+ * memory usage does not depend on the size of the input.
+ */
+class StructuralIndex
+{
+public:
+  static const size_t npos = static_cast<size_t>(-1);
+
+  StructuralIndex(const char* data, size_t size, SimdLevel level = simd_level())
+    : m_data(data),
+      m_size(size),
+      m_indexed(0),
+      m_read(0),
+      m_classify(details::classify_function(level)),
+      m_prev_escaped(0),
+      m_prev_in_string(0),
+      m_prev_scalar(0)
+  {
+    m_positions.reserve(window_size);
+  }
+
+  ~StructuralIndex() = default;
+
+  // Returns the position of the next structural character or npos.
+  size_t next()
+  {
+    if (m_read == m_positions.size())
+    {
+      if (!refill())
+        return npos;
+    }
+
+    return m_positions[m_read++];
+  }
+
+  // Discards the positions that are before `offset`.
+  void skip(size_t offset)
+  {
+    for (;;)
+    {
+      for (; m_read < m_positions.size(); ++m_read)
+      {
+        if (m_positions[m_read] >= offset)
+          return;
+      }
+
+      if (!refill())
+        return;
+    }
+  }
+
+protected:
+  static const size_t window_size = 64 * details::block_size;
+
+  bool refill()
+  {
+    m_positions.clear();
+    m_read = 0;
+
+    while (m_positions.empty() && m_indexed < m_size)
+    {
+      const size_t window_end = m_indexed + window_size < m_size ? m_indexed + window_size : m_size;
+
+      while (m_indexed + details::block_size <= window_end)
+      {
+        indexBlock(m_data + m_indexed);
+        m_indexed += details::block_size;
+      }
+
+      if (m_indexed < window_end)
+      {
+        // the last block is padded with spaces
+        char block[details::block_size];
+        std::memset(block, ' ', details::block_size);
+        std::memcpy(block, m_data + m_indexed, window_end - m_indexed);
+        indexBlock(block);
+        m_indexed = window_end;
+      }
+    }
+
+    return !m_positions.empty();
+  }
+
+  // Computes the characters that are preceded by an odd number of backslashes.
+  uint64_t escaped(uint64_t backslash)
+  {
+    uint64_t result = m_prev_escaped;
+    m_prev_escaped = 0;
+
+    while (backslash)
+    {
+      const int i = details::trailing_zeros(backslash);
+      backslash &= backslash - 1;
+
+      if ((result >> i) & 1)
+        continue;
+
+      if (i == 63)
+        m_prev_escaped = 1;
+      else
+        result |= uint64_t(1) << (i + 1);
+    }
+
+    return result;
+  }
+
+  void indexBlock(const char* block)
+  {
+    details::BlockMasks masks;
+    m_classify(block, masks);
+
+    const uint64_t quote = masks.quote & ~escaped(masks.backslash);
+
+    // the opening quotes and the content of the strings
+    const uint64_t in_string = details::prefix_xor(quote) ^ m_prev_in_string;
+    m_prev_in_string = (in_string >> 63) ? ~uint64_t(0) : 0;
+
+    const uint64_t outside = ~in_string & ~quote;
+    const uint64_t scalar = outside & ~(masks.op | masks.single_quote | masks.space | masks.newline);
+    const uint64_t scalar_start = scalar & ~((scalar << 1) | m_prev_scalar);
+    m_prev_scalar = scalar >> 63;
+
+    uint64_t structurals = quote | scalar_start
+      | (outside & (masks.op | masks.single_quote))
+      | (in_string & ~quote & (masks.backslash | masks.newline));
+
+    while (structurals)
+    {
+      m_positions.push_back(m_indexed + details::trailing_zeros(structurals));
+      structurals &= structurals - 1;
+    }
+  }
+
+private:
+  const char* m_data;
+  size_t m_size;
+  size_t m_indexed;
+  std::vector<size_t> m_positions;
+  size_t m_read;
+  details::ClassifyFunction m_classify;
+  uint64_t m_prev_escaped;
+  uint64_t m_prev_in_string;
+  uint64_t m_prev_scalar;
+};
+
+} // namespace json
+
+#endif // !JSONTOOLKIT_STRUCTURAL_INDEX_H
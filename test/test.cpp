@@ -4,15 +4,68 @@
 
 #include <gtest/gtest.h>
 
+#include "json-toolkit/columnar.h"
 #include "json-toolkit/json.h"
 #include "json-toolkit/parsing.h"
+#include "json-toolkit/persistent.h"
 #include "json-toolkit/serialization.h"
+#include "json-toolkit/snapshot.h"
+#include "json-toolkit/stream-writer.h"
 #include "json-toolkit/stringify.h"
 
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
 #if __cplusplus >= 201703L
 #include <variant>
 #endif
 
+// Counts the allocations made by the tests.
+// All the non-aligned forms of the global allocation functions are
+// replaced; they are not inlined so that GCC does not match malloc()
+// and free() with the new and delete expressions (-Wmismatched-new-delete).
+static std::atomic<size_t> allocation_count{ 0 };
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TEST_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define TEST_NOINLINE __declspec(noinline)
+#else
+#define TEST_NOINLINE
+#endif
+
+TEST_NOINLINE void* operator new(size_t size)
+{
+  ++allocation_count;
+
+  if (void* ptr = std::malloc(size ? size : 1))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+TEST_NOINLINE void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+  ++allocation_count;
+  return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+
+TEST_NOINLINE void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { operator delete(ptr); }
+
 TEST(jsontest, values)
 {
   json::Json var = nullptr;
@@ -37,6 +90,48 @@ TEST(jsontest, values)
   ASSERT_TRUE(var.isString());
 }
 
+TEST(jsontest, sharing)
+{
+  static_assert(sizeof(json::Json) <= 16, "json::Json should fit in 16 bytes");
+
+  json::Json num = 3.14;
+  ASSERT_EQ(num.impl(), nullptr);
+
+  json::Json str = "Hello";
+  json::Json copy = str;
+  ASSERT_NE(str.impl(), nullptr);
+  ASSERT_EQ(copy.impl(), str.impl());
+  ASSERT_EQ(str.impl()->ref_count.load(), 2);
+
+  copy = copy;
+  ASSERT_EQ(str.impl()->ref_count.load(), 2);
+
+  copy = 5;
+  ASSERT_EQ(str.impl()->ref_count.load(), 1);
+  ASSERT_EQ(copy, 5);
+
+  json::Json moved = std::move(str);
+  ASSERT_TRUE(str.isNull());
+  ASSERT_EQ(moved.toString(), "Hello");
+  ASSERT_EQ(moved.impl()->ref_count.load(), 1);
+
+  json::Array array;
+  json::Array other = array;
+  other.push(1);
+#if defined(JSONTOOLKIT_COPY_ON_WRITE)
+  ASSERT_EQ(array.length(), 0);
+  ASSERT_EQ(other.length(), 1);
+  array.push(1);
+#else
+  // arrays are shared between copies
+  ASSERT_EQ(array.length(), 1);
+#endif // defined(JSONTOOLKIT_COPY_ON_WRITE)
+
+  ASSERT_TRUE(json::Array(moved).isNull());
+  ASSERT_TRUE(json::Object(array).isNull());
+  ASSERT_FALSE(json::Array(json::Json(array)).isNull());
+}
+
 
 TEST(jsontest, arrays)
 {
@@ -106,6 +201,504 @@ TEST(jsontest, objects)
   ASSERT_TRUE(obj != val);
 }
 
+TEST(jsontest, moves)
+{
+  std::string str(100, 'x');
+  const char* buffer = str.data();
+
+  // the string is moved into its node
+  size_t count = allocation_count;
+  json::Json value{ std::move(str) };
+  ASSERT_EQ(allocation_count - count, 1u);
+  ASSERT_EQ(value.toString().data(), buffer);
+
+  json::Array array;
+  json::Object obj;
+
+  // the storage of the array grows twice, the string and its node
+  // are allocated once
+  count = allocation_count;
+  array.push(std::move(value));
+  array.push(json::Json(std::string(100, 'y')));
+  ASSERT_EQ(allocation_count - count, 4u);
+  ASSERT_TRUE(value.isNull());
+  ASSERT_EQ(array.at(0).toString().data(), buffer);
+  ASSERT_EQ(array.data().front().impl()->ref_count.load(), 1);
+
+  // the elements are moved, not copied, when the storage grows
+  static_assert(std::is_nothrow_move_constructible<json::Json>::value, "");
+  json::Array strings;
+
+  for (int i(0); i < 100; ++i)
+    strings.push(json::Json(std::string(100, 'a' + i % 26)));
+
+  ASSERT_EQ(strings.length(), 100);
+
+  for (const json::Json& e : strings.data())
+    ASSERT_EQ(e.impl()->ref_count.load(), 1);
+
+  // insert() does not create a value that is then overwritten
+  obj.insert("values", std::move(array));
+  obj.insert("number", 3.14);
+  count = allocation_count;
+  obj.insert("number", 2);
+  ASSERT_EQ(allocation_count - count, 0u);
+  ASSERT_EQ(obj.data().size(), 2u);
+  ASSERT_EQ(obj["number"], 2);
+  ASSERT_EQ(obj["values"].impl()->ref_count.load(), 1);
+
+  // parsed strings are moved into their node
+  const std::string short_doc = "[\"" + std::string(10, 'z') + "\"]";
+  const std::string long_doc = "[\"" + std::string(100, 'z') + "\"]";
+  count = allocation_count;
+  json::parse(short_doc);
+  const size_t short_count = allocation_count - count;
+  count = allocation_count;
+  json::parse(long_doc);
+  const size_t long_count = allocation_count - count;
+  ASSERT_EQ(long_count, short_count + 1);
+
+  // a child can be assigned to its parent, which owns it
+  json::Json parent = json::parse("{ \"a\": { \"b\": [1, \"x\"] } }");
+  parent = parent["a"];
+  ASSERT_EQ(parent, json::parse("{ \"b\": [1, \"x\"] }"));
+  parent = std::move(parent["b"]);
+  ASSERT_EQ(parent, json::parse("[1, \"x\"]"));
+}
+
+TEST(jsontest, lookups)
+{
+  json::Json obj = json::parse("{ \"a\": 1, \"b\": null }");
+  const json::Json& cobj = obj;
+
+  size_t count = allocation_count;
+  ASSERT_TRUE(obj.contains("a"));
+  ASSERT_TRUE(obj.contains(std::string("b")));
+  ASSERT_FALSE(obj.contains("c"));
+  ASSERT_EQ(*cobj.find("a"), 1);
+  ASSERT_EQ(cobj.find("c"), nullptr);
+  ASSERT_EQ(cobj["a"], 1);
+  ASSERT_TRUE(cobj["c"].isNull());
+  ASSERT_TRUE(json::JsonView(obj).contains("b"));
+  ASSERT_EQ(allocation_count - count, 0u);
+
+  // find() and contains() do not insert
+  ASSERT_EQ(obj.toObject().data().size(), 2u);
+
+  *obj.find("a") = 2;
+  ASSERT_EQ(obj["a"], 2);
+}
+
+TEST(jsontest, views)
+{
+  json::Json doc = json::parse("{ \"name\": \"doc\", \"values\": [1, 2.5, true, null, [\"a\"]] }");
+  json::Json values = doc["values"];
+  const int ref_count = values.impl()->ref_count.load();
+
+  json::JsonView view = doc;
+  ASSERT_TRUE(view.isObject());
+  ASSERT_EQ(view["name"].toString(), "doc");
+  ASSERT_TRUE(view["missing"].isNull());
+  ASSERT_EQ(view.fields().size(), 2u);
+
+  json::JsonView array = view["values"];
+  ASSERT_TRUE(array.isArray());
+  ASSERT_EQ(array.length(), 5);
+  ASSERT_EQ(array[0].toInt(), 1);
+  ASSERT_EQ(array.at(1).toNumber(), 2.5);
+  ASSERT_TRUE(array[2].toBool());
+  ASSERT_TRUE(array[3].isNull());
+  ASSERT_EQ(array[4][0].toString(), "a");
+  ASSERT_EQ(&array[4].json(), &json::JsonView(values).elements().back());
+
+  int count = 0;
+  for (json::JsonView e : array.elements())
+    count += e.isNull() ? 0 : 1;
+  ASSERT_EQ(count, 4);
+
+  // views do not hold references
+  ASSERT_EQ(values.impl()->ref_count.load(), ref_count);
+
+  ASSERT_EQ(json::compare(view, json::JsonView(doc)), 0);
+  ASSERT_EQ(json::compare(array[0], array[4]), -1);
+  ASSERT_TRUE(json::JsonView().isNull());
+}
+
+TEST(jsontest, objectsOrder)
+{
+  json::Json val = json::parse("{ \"b\": 1, \"c\": 2, \"a\": 3 }");
+
+  std::vector<std::string> keys;
+  for (const auto& e : json::JsonView(val).fields())
+    keys.push_back(e.first);
+  ASSERT_EQ(keys, std::vector<std::string>({ "b", "c", "a" }));
+
+  ASSERT_EQ(json::stringify(val), json::stringify(json::parse(json::stringify(val))));
+
+  // the insertion order does not matter for comparison
+  json::Json other = json::parse("{ \"a\": 3, \"b\": 1, \"c\": 2 }");
+  ASSERT_EQ(val, other);
+  other["a"] = 4;
+  ASSERT_NE(val, other);
+  ASSERT_EQ(json::compare(val, other), -json::compare(other, val));
+  ASSERT_EQ(json::compare(val, other), -1);
+
+  // large objects are indexed
+  json::Object large;
+  for (int i(0); i < 100; ++i)
+    large["key" + std::to_string(i)] = i;
+
+  ASSERT_EQ(large.data().size(), 100u);
+  ASSERT_EQ(large["key57"], 57);
+  ASSERT_EQ(large.data().count("key100"), 0u);
+  ASSERT_EQ(large.data().begin()->first, "key0");
+
+  large.data().erase("key0");
+  ASSERT_EQ(large.data().count("key0"), 0u);
+  ASSERT_EQ(large.data().at("key99"), 99);
+  ASSERT_EQ(large.data().begin()->first, "key1");
+}
+
+TEST(jsontest, freeze)
+{
+  // the non-const accessors of a frozen value make a copy, reads go through
+  // a const reference
+  json::Json value = json::parse("{ \"config\": { \"retries\": 3, \"hosts\": [\"a\", \"b\"] }, \"name\": \"service\" }");
+  const json::Json& doc = value;
+  const json::Json reference = json::parse("{ \"config\": { \"retries\": 3, \"hosts\": [\"a\", \"b\"] }, \"name\": \"service\" }");
+  value.freeze();
+  ASSERT_TRUE(doc.isFrozen());
+  ASSERT_TRUE(doc["config"]["hosts"].isFrozen());
+
+  // modifying a copy of a frozen value only copies the modified path
+  json::Json copy = doc;
+  copy["config"]["hosts"].push("c");
+  ASSERT_EQ(doc, reference);
+  ASSERT_EQ(copy["config"]["hosts"].length(), 3);
+  ASSERT_NE(copy.impl(), doc.impl());
+  ASSERT_NE(copy["config"].impl(), doc["config"].impl());
+  ASSERT_EQ(copy["name"].impl(), doc["name"].impl());
+  ASSERT_FALSE(copy.isFrozen());
+
+  // frozen values are copied on write even if they are not shared
+  json::Json frozen = json::Array();
+  frozen.freeze();
+  const json::details::Node* node = frozen.impl();
+  frozen.push(1);
+  ASSERT_NE(frozen.impl(), node);
+  ASSERT_EQ(frozen.length(), 1);
+  ASSERT_FALSE(frozen.isFrozen());
+
+  // values allocated in an arena are copied to the heap
+  json::Arena arena;
+  json::Json arrays = json::parse("[[1], [2]]", arena);
+  arrays.freeze();
+  json::Json modified = arrays;
+  modified[0].push(3);
+  ASSERT_EQ(modified.impl()->arena, nullptr);
+  ASSERT_EQ(modified.at(1).impl()->arena, &arena);
+  ASSERT_EQ(arrays.at(0).length(), 1);
+  ASSERT_EQ(modified.at(0).length(), 2);
+}
+
+TEST(jsontest, persistent)
+{
+  json::PersistentObject v1;
+  for (int i(0); i < 2000; ++i)
+    v1 = v1.insert("key" + std::to_string(i), i);
+
+  ASSERT_EQ(v1.size(), 2000u);
+  ASSERT_EQ(v1["key1234"], 1234);
+  ASSERT_TRUE(v1["missing"].isNull());
+
+  // modified versions do not change the previous ones
+  json::PersistentObject v2 = v1.insert("key1234", "modified").insert("new", true).erase("key0");
+  ASSERT_EQ(v2.size(), 2000u);
+  ASSERT_EQ(v2["key1234"], "modified");
+  ASSERT_EQ(v1["key1234"], 1234);
+  ASSERT_FALSE(v2.contains("key0"));
+  ASSERT_TRUE(v1.contains("key0"));
+  ASSERT_EQ(v1.erase("missing").size(), 2000u);
+
+  json::Json object = v2.toJson();
+  ASSERT_EQ(object.toObject().data().size(), 2000u);
+  ASSERT_EQ(json::PersistentObject(object).toJson(), object);
+
+  size_t count = 0;
+  v1.forEach([&count](const json::Key&, const json::Json&) { ++count; });
+  ASSERT_EQ(count, 2000u);
+
+  json::PersistentArray a1;
+  for (int i(0); i < 5000; ++i)
+    a1 = a1.push(i);
+
+  json::PersistentArray a2 = a1.set(10, -1).set(4999, -2).push(5000);
+  ASSERT_EQ(a1.length(), 5000);
+  ASSERT_EQ(a2.length(), 5001);
+  ASSERT_EQ(a1.at(10), 10);
+  ASSERT_EQ(a2.at(10), -1);
+  ASSERT_EQ(a1.at(4999), 4999);
+  ASSERT_EQ(a2[4999], -2);
+  ASSERT_EQ(a2[5000], 5000);
+
+  json::Json array = a1.toJson();
+  ASSERT_EQ(array.length(), 5000);
+  ASSERT_EQ(array.at(1234), 1234);
+  ASSERT_EQ(json::PersistentArray(array).toJson(), array);
+  ASSERT_TRUE(array.at(0).impl() == nullptr && json::PersistentArray(json::parse("[[1]]")).at(0).isFrozen());
+}
+
+TEST(jsontest, snapshot)
+{
+  json::AtomicSnapshot snapshot{ json::parse("{ \"version\": 0, \"check\": 0 }") };
+
+  {
+    json::AtomicSnapshot::Reader reader = snapshot.read();
+    ASSERT_TRUE(reader->isFrozen());
+    ASSERT_EQ(reader.view()["version"].toInt(), 0);
+
+    // the value that is read is kept alive
+    snapshot.publish(json::parse("{ \"version\": 1, \"check\": 2 }"));
+    ASSERT_EQ(reader.view()["version"].toInt(), 0);
+    ASSERT_EQ(snapshot.read().view()["version"].toInt(), 1);
+    ASSERT_EQ(snapshot.pending(), 1u);
+  }
+
+  snapshot.collect();
+  ASSERT_EQ(snapshot.pending(), 0u);
+  ASSERT_EQ(snapshot.load()["check"], 2);
+
+  std::atomic<bool> done{ false };
+  std::atomic<int> errors{ 0 };
+  std::vector<std::thread> readers;
+
+  for (int i(0); i < 4; ++i)
+  {
+    readers.emplace_back([&]() {
+      while (!done.load())
+      {
+        json::AtomicSnapshot::Reader reader = snapshot.read();
+        json::JsonView view = reader.view();
+
+        if (view["check"].toInt() != 2 * view["version"].toInt())
+          ++errors;
+      }
+    });
+  }
+
+  for (int v(2); v < 200; ++v)
+  {
+    json::Object value;
+    value["version"] = v;
+    value["check"] = 2 * v;
+    snapshot.publish(value);
+  }
+
+  done = true;
+
+  for (std::thread& t : readers)
+    t.join();
+
+  ASSERT_EQ(errors.load(), 0);
+  ASSERT_EQ(snapshot.load()["version"], 199);
+  snapshot.collect();
+  ASSERT_EQ(snapshot.pending(), 0u);
+}
+
+TEST(jsontest, hashing)
+{
+  json::Json a = json::parse("{ \"b\": [1, 2.5, \"x\"], \"a\": { \"c\": null } }");
+  json::Json b = json::parse("{ \"a\": { \"c\": null }, \"b\": [1, 2.5, \"x\"] }");
+
+  ASSERT_EQ(a, b);
+  ASSERT_EQ(json::hash(a), json::hash(b));
+  ASSERT_NE(json::hash(json::Json(1)), json::hash(json::Json(1.0)));
+  ASSERT_EQ(json::hash(json::Json(0.0)), json::hash(json::Json(-0.0)));
+
+  // modifying a nested value changes the hash of its parents
+  const size_t h = json::hash(a);
+  a["a"]["c"] = true;
+  ASSERT_NE(json::hash(a), h);
+  ASSERT_NE(a, b);
+  a["a"]["c"] = nullptr;
+  ASSERT_EQ(json::hash(a), h);
+  ASSERT_EQ(a, b);
+
+  a["b"].push(3);
+  ASSERT_NE(json::hash(a), h);
+
+  // writes through references obtained before the hash was computed
+  json::Json c = json::parse("[1, \"s\"]");
+  json::Json d = json::parse("[2, \"s\"]");
+  json::Json& slot = c[0];
+  json::hash(c);
+  json::hash(d);
+  slot = 2;
+  ASSERT_EQ(c, d);
+
+  json::Object o = json::parse("{ \"f\": 1 }").toObject();
+  json::Json p = json::parse("{ \"f\": 5 }");
+  auto& fields = o.data();
+  json::hash(o);
+  json::hash(p);
+  fields.begin()->second = 5;
+  ASSERT_EQ(o, p);
+
+  // the hash of frozen values is cached
+  json::Json frozen = json::parse("[[1], [2]]");
+  json::Json other = json::parse("[[1], [3]]");
+  frozen.freeze();
+  other.freeze();
+  ASSERT_EQ(json::hash(frozen), json::hash(json::parse("[[1], [2]]")));
+  ASSERT_NE(frozen, other);
+
+  std::unordered_set<json::Json> values;
+  values.insert(json::parse("[1, 2, 3]"));
+  values.insert(json::parse("{ \"x\": 1, \"y\": 2 }"));
+  values.insert(json::parse("[1, 2, 3]"));
+  values.insert(json::parse("{ \"y\": 2, \"x\": 1 }"));
+  ASSERT_EQ(values.size(), 2u);
+}
+
+TEST(jsontest, packed)
+{
+  json::Array numbers{ json::parse("[0.5, 1.5, 2.5, 3.5]") };
+  json::Array integers{ json::parse("[1, 2, 3]") };
+  json::Array mixed{ json::parse("[1, 2.5, 3]") };
+
+  ASSERT_EQ(numbers.numbers().size(), 4u);
+  ASSERT_EQ(numbers.numbers()[3], 3.5);
+  ASSERT_TRUE(numbers.integers().empty());
+  ASSERT_EQ(integers.integers().size(), 3u);
+  ASSERT_TRUE(mixed.integers().empty() && mixed.numbers().empty());
+
+  // packed arrays are read as any other array
+  ASSERT_EQ(numbers.length(), 4);
+  ASSERT_EQ(numbers.at(1), 1.5);
+  ASSERT_EQ(json::JsonView(integers)[2].toInt(), 3);
+  ASSERT_EQ(json::JsonView(integers).elements().back(), 3);
+  ASSERT_EQ(json::stringify(integers), "[1, 2, 3]");
+
+  json::Array copy;
+  copy.data().push_back(1);
+  copy.data().push_back(2);
+  copy.data().push_back(3);
+  ASSERT_TRUE(copy.integers().empty());
+  ASSERT_EQ(copy, integers);
+  ASSERT_EQ(json::hash(copy), json::hash(integers));
+  ASSERT_TRUE(copy.pack());
+  ASSERT_EQ(copy.integers().size(), 3u);
+  ASSERT_EQ(copy, integers);
+
+  // pushing a value of another type unpacks the array
+  integers.push(4);
+  ASSERT_EQ(integers.integers().size(), 4u);
+  integers.push("five");
+  ASSERT_TRUE(integers.integers().empty());
+  ASSERT_EQ(integers.length(), 5);
+  ASSERT_EQ(integers.at(3), 4);
+  ASSERT_EQ(integers.at(4), "five");
+
+  // so does modifying an element in place
+  numbers[0] = 1.0;
+  ASSERT_TRUE(numbers.numbers().empty());
+  ASSERT_EQ(numbers.at(0), 1.0);
+  ASSERT_EQ(numbers.at(3), 3.5);
+}
+
+TEST(jsontest, columnar)
+{
+  json::Json records = json::parse("[{ \"ts\": 1, \"host\": \"a\", \"value\": 0.5, \"tags\": [] },"
+    "{ \"ts\": 2, \"host\": \"b\", \"value\": 1.5, \"tags\": null },"
+    "{ \"ts\": 3, \"host\": \"a\", \"value\": 2.5, \"tags\": [\"x\"] }]");
+
+  ASSERT_TRUE(json::ColumnarArray::convertible(records));
+  json::ColumnarArray table{ records };
+  ASSERT_EQ(table.length(), 3);
+  ASSERT_EQ(table.columns().size(), 4u);
+
+  const json::Column& ts = *table.column("ts");
+  ASSERT_EQ(ts.type(), json::ColumnType::Integer);
+  ASSERT_EQ(ts.integers().size(), 3u);
+  ASSERT_EQ(ts.integers()[2], 3);
+
+  double sum = 0;
+  for (double x : table.column("value")->numbers())
+    sum += x;
+  ASSERT_EQ(sum, 4.5);
+
+  // strings are stored once
+  const json::Column& host = *table.column("host");
+  ASSERT_EQ(host.type(), json::ColumnType::String);
+  ASSERT_EQ(host.dictionary().size(), 2u);
+  ASSERT_EQ(host.indices()[2], host.indices()[0]);
+
+  ASSERT_EQ(table.column("tags")->type(), json::ColumnType::Mixed);
+  ASSERT_EQ(table.column("missing"), nullptr);
+
+  // rows are read as objects
+  json::ColumnarArray::Row row = table[1];
+  ASSERT_EQ(row["ts"], 2);
+  ASSERT_EQ(row["host"], "b");
+  ASSERT_TRUE(row["tags"].isNull());
+  ASSERT_TRUE(row["missing"].isNull());
+  ASSERT_TRUE(row.contains("value"));
+  ASSERT_EQ(row.toJson(), records.at(1));
+  ASSERT_EQ(table.toJson(), records);
+
+  ASSERT_FALSE(json::ColumnarArray::convertible(json::parse("[{ \"a\": 1 }, { \"b\": 1 }]")));
+  ASSERT_FALSE(json::ColumnarArray::convertible(json::parse("[{ \"a\": 1 }, 2]")));
+  ASSERT_TRUE(json::ColumnarArray(json::parse("[1, 2]")).empty());
+}
+
+struct TypeCounter
+{
+  int counts[7] = { 0 };
+
+  void operator()(std::nullptr_t) { counts[0] += 1; }
+  void operator()(bool) { counts[1] += 1; }
+  void operator()(int) { counts[2] += 1; }
+  void operator()(double) { counts[3] += 1; }
+  void operator()(const std::string&) { counts[4] += 1; }
+
+  void operator()(json::ArrayView array)
+  {
+    counts[5] += 1;
+
+    for (int i(0); i < array.length(); ++i)
+      json::visit(*this, array[i]);
+  }
+
+  void operator()(const json::ObjectStorage& fields)
+  {
+    counts[6] += 1;
+
+    for (const auto& f : fields)
+      json::visit(*this, f.second);
+  }
+};
+
+TEST(jsontest, visit)
+{
+  json::Json value = json::parse("{ \"a\": [1, 2, 3], \"b\": [true, null, 2.5, \"s\", {}], \"c\": 0.5 }");
+
+  TypeCounter counter;
+  json::visit(counter, value);
+  ASSERT_EQ(counter.counts[0], 1);
+  ASSERT_EQ(counter.counts[1], 1);
+  ASSERT_EQ(counter.counts[2], 3);
+  ASSERT_EQ(counter.counts[3], 2);
+  ASSERT_EQ(counter.counts[4], 1);
+  ASSERT_EQ(counter.counts[5], 2);
+  ASSERT_EQ(counter.counts[6], 2);
+
+  // scalars are decoded through visit(), integers are accepted as numbers
+  json::Serializer s;
+  ASSERT_EQ(s.decode<std::vector<double>>(json::parse("[1, 2.5]")), std::vector<double>({ 1.0, 2.5 }));
+  ASSERT_THROW(s.decode<int>(json::Json("one")), std::runtime_error);
+  ASSERT_THROW(s.decode<std::string>(json::Json(1)), std::runtime_error);
+}
+
 struct Point
 {
   int x; 
@@ -361,4 +954,146 @@ TEST(jsontest, stringify)
   json::Object parsed = json::parse(str).toObject();
 
   ASSERT_EQ(obj, parsed);
+
+  json::Json numbers = json::parse("[0.1, 1.0, 1e300, 5e-324, -1500.0, 123456.789]");
+  ASSERT_EQ(json::stringify(numbers), "[0.1, 1.0, 1e+300, 5e-324, -1500.0, 123456.789]");
+  ASSERT_EQ(json::parse(json::stringify(numbers)), numbers);
+
+  // infinities and NaNs have no JSON representation
+  json::Json invalid = json::Array();
+  invalid.push(std::numeric_limits<double>::infinity());
+  ASSERT_THROW(json::stringify(invalid), std::runtime_error);
+}
+
+TEST(jsontest, stringify_options)
+{
+  json::Json value = json::parse("{ \"name\": \"Alice\", \"tags\": [1, 2], \"book\": { \"year\": 2019 }, \"empty\": {} }");
+
+  ASSERT_EQ(json::stringify(value, json::Compact), "{\"name\":\"Alice\",\"tags\":[1,2],\"book\":{\"year\":2019},\"empty\":{}}");
+  ASSERT_EQ(json::stringify(value), json::stringify(value, json::indented(2)));
+  ASSERT_EQ(json::stringify(value, json::indented(4)),
+    "{\n"
+    "    \"name\": \"Alice\",\n"
+    "    \"tags\": [1, 2],\n"
+    "    \"book\": {\n"
+    "        \"year\": 2019\n"
+    "    },\n"
+    "    \"empty\": {}\n"
+    "}");
+  ASSERT_EQ(json::parse(json::stringify(value, json::Compact)), value);
+  ASSERT_EQ(json::parse(json::stringify(value, json::indented(0))), value);
+  ASSERT_EQ(json::stringify(value, json::indented(-3)), json::stringify(value, json::indented(0)));
+  ASSERT_EQ(json::stringify(value, json::indented(1), json::AsciiOnly), json::stringify(value, json::PrettyFormat(1)));
+}
+
+TEST(jsontest, stringify_escapes)
+{
+  json::Json value = "say \"hi\"\\\r\n\t\b\f\x01\x1f caf\xc3\xa9";
+
+  ASSERT_EQ(json::stringify(value), "\"say \\\"hi\\\"\\\\\\r\\n\\t\\b\\f\\u0001\\u001f caf\xc3\xa9\"");
+  json::Json array = json::Array();
+  array.push("\"quoted\" \\ \r\n\t");
+  ASSERT_EQ(json::parse(json::stringify(array)), array);
+
+  // the escape is found wherever it is in the string
+  for (size_t size(1); size < 80; ++size)
+  {
+    for (size_t pos(0); pos < size; ++pos)
+    {
+      std::string str(size, 'a');
+      str[pos] = '\n';
+      std::string expected = "\"" + std::string(pos, 'a') + "\\n" + std::string(size - pos - 1, 'a') + "\"";
+      ASSERT_EQ(json::stringify(json::Json(str)), expected);
+    }
+  }
+
+  json::Json unicode = "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xff";
+  ASSERT_EQ(json::stringify(unicode), "\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xff\"");
+  ASSERT_EQ(json::stringify(unicode, json::AsciiOnly), "\"caf\\u00e9 \\u20ac \\ud83d\\ude00 \\ufffd\"");
+
+  json::Json obj = json::Object();
+  obj["cl\xc3\xa9"] = "\xc3\xa9t\xc3\xa9";
+  ASSERT_EQ(json::stringify(obj, json::Compact | json::AsciiOnly), "{\"cl\\u00e9\":\"\\u00e9t\\u00e9\"}");
+
+  // everything that is escaped is read back by parse()
+  json::Json escaped = json::Array();
+  escaped.push(value);
+  escaped.push("a\bb");
+  escaped.push("a\fb");
+  escaped.push("a\x01z\x7f/");
+  escaped.push("caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80");
+  ASSERT_EQ(json::parse(json::stringify(escaped)), escaped);
+  ASSERT_EQ(json::parse(json::stringify(escaped, json::AsciiOnly)), escaped);
+  ASSERT_EQ(json::parse(json::stringify(obj, json::AsciiOnly)), obj);
+}
+
+// Records the size of the writes made to a StreamWriterBackend.
+struct RecordingSink
+{
+  std::string output;
+  size_t largest_write = 0;
+  int gathered_writes = 0;
+
+  void write(const char* data, size_t size)
+  {
+    output.append(data, size);
+    largest_write = std::max(largest_write, size);
+  }
+
+  void write(const char* first, size_t first_size, const char* second, size_t second_size)
+  {
+    write(first, first_size);
+    output.append(second, second_size);
+    ++gathered_writes;
+  }
+};
+
+TEST(jsontest, stringify_to)
+{
+  json::Json value = json::Array();
+
+  for (int i(0); i < 100; ++i)
+  {
+    json::Json obj = json::Object();
+    obj["id"] = i;
+    obj["ratio"] = i / 7.0;
+    obj["message"] = "line \"" + std::to_string(i) + "\"\n" + std::string(i % 10 == 0 ? 200 : 10, 'x');
+    value.push(obj);
+  }
+
+  std::ostringstream stream;
+  json::stringify_to(json::OStreamSink(stream), value);
+  ASSERT_EQ(stream.str(), json::stringify(value));
+
+  stream.str("");
+  json::stringify_to(json::OStreamSink(stream), value, json::Compact | json::AsciiOnly);
+  ASSERT_EQ(stream.str(), json::stringify(value, json::Compact | json::AsciiOnly));
+
+  stream.str("");
+  json::stringify_to(json::OStreamSink(stream), value, json::indented(4));
+  ASSERT_EQ(stream.str(), json::stringify(value, json::indented(4)));
+
+  // a small buffer is flushed as often as needed, long strings are not copied
+  RecordingSink sink;
+  json::GenericWriter<json::StreamWriterBackend<RecordingSink&>, json::CompactFormat> small{ json::CompactFormat(), json::StreamWriterBackend<RecordingSink&>(sink, 64) };
+  json::details::write(small, value);
+  small.backend().flush();
+  ASSERT_EQ(sink.output, json::stringify(value, json::Compact));
+  ASSERT_LT(sink.largest_write, 128u);
+  ASSERT_EQ(sink.gathered_writes, 10);
+
+  std::FILE* file = std::tmpfile();
+  ASSERT_NE(file, nullptr);
+  json::stringify_to(json::FileSink(file), value);
+  ASSERT_EQ(std::ftell(file), static_cast<long>(json::stringify(value).size()));
+
+#if defined(JSONTOOLKIT_POSIX)
+  std::rewind(file);
+  json::stringify_to(json::FileDescriptorSink(fileno(file)), value, json::Compact);
+  std::string content(json::stringify(value, json::Compact).size(), '\0');
+  ASSERT_EQ(::pread(fileno(file), &content[0], content.size(), 0), static_cast<ssize_t>(content.size()));
+  ASSERT_EQ(content, json::stringify(value, json::Compact));
+#endif // defined(JSONTOOLKIT_POSIX)
+
+  std::fclose(file);
 }
\ No newline at end of file
@@ -4,8 +4,12 @@
 
 #include <gtest/gtest.h>
 
+#include "json-toolkit/deduplication.h"
+#include "json-toolkit/document.h"
 #include "json-toolkit/parsing.h"
 
+#include <limits>
+
 TEST(parsing, tokenizer)
 {
   using namespace json;
@@ -211,6 +215,29 @@ TEST(parsing, parser_machine_string_3)
   ASSERT_EQ(vec.at(0).toString(), "'\n\r\t\"\\");
 }
 
+TEST(parsing, unicode_escapes)
+{
+  json::Json value = json::parse("[\"\\b\\f\\/\\u0041\\u00e9\\u20AC\\ud83d\\ude00\", 'caf\\u00e9']");
+
+  ASSERT_EQ(value.at(0).toString(), "\b\f/A\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+  ASSERT_EQ(value.at(1).toString(), "caf\xc3\xa9");
+
+  // the escape sequences may be split between several inputs
+  json::Tokenizer<json::DefaultTokenizerBackend> tokenizer;
+  tokenizer.write(std::string("\"\\ud8"));
+  tokenizer.write(std::string("3d\\ude"));
+  tokenizer.write(std::string("00\""));
+  ASSERT_EQ(tokenizer.backend().token_buffer.size(), 1u);
+  ASSERT_EQ(tokenizer.backend().token_buffer.front().text, "\"\xf0\x9f\x98\x80\"");
+
+  ASSERT_ANY_THROW(json::parse("[\"\\u00g0\"]"));
+  ASSERT_ANY_THROW(json::parse("[\"\\ud83d\"]"));
+  ASSERT_ANY_THROW(json::parse("[\"\\ud83dx\"]"));
+  ASSERT_ANY_THROW(json::parse("[\"\\ud83d\\n\"]"));
+  ASSERT_ANY_THROW(json::parse("[\"\\ude00\"]"));
+  ASSERT_ANY_THROW(json::parse("[\"\\ud83d\\u0041\"]"));
+}
+
 TEST(parsing, parser_machine_exceptions)
 {
   using namespace json;
@@ -235,3 +262,496 @@ TEST(parsing, parser_machine_exceptions)
   ASSERT_EQ(parser.state(), ParserState::Idle);
   parser.backend().stack.clear();
 }
+
+TEST(parsing, parsing_tokenizer_backend)
+{
+  using namespace json;
+
+  Tokenizer<ParsingTokenizerBackend<DefaultParserBackend>> tokenizer;
+  auto& parser = tokenizer.backend().parser;
+
+  tokenizer.write("{ name: 'Ali");
+  ASSERT_EQ(parser.state(), ParserState::ReadFieldColon);
+
+  tokenizer.write("ce', values: [1, 2.5, true");
+  ASSERT_EQ(parser.state(), ParserState::ReadArraySeparator);
+
+  tokenizer.write("] }");
+  tokenizer.done();
+
+  ASSERT_EQ(parser.state(), ParserState::Idle);
+  ASSERT_EQ(parser.backend().stack.size(), 1u);
+
+  json::Json obj = parser.backend().stack.front();
+  ASSERT_EQ(obj["name"], "Alice");
+  ASSERT_EQ(obj["values"].length(), 3);
+  ASSERT_EQ(obj["values"].at(1), 2.5);
+}
+
+namespace
+{
+
+struct ViewRecorderBackend : public json::BasicTokenizerBackend
+{
+  std::vector<json::Token> tokens;
+  std::vector<const char*> addresses;
+
+  void produce(json::TokenType ttype, json::StringView text)
+  {
+    tokens.push_back(json::Token(ttype, text));
+    addresses.push_back(text.data());
+  }
+};
+
+} // namespace
+
+TEST(parsing, tokenizer_zero_copy)
+{
+  using namespace json;
+
+  Tokenizer<ViewRecorderBackend> tokenizer;
+  auto& tokens = tokenizer.backend().tokens;
+  auto& addresses = tokenizer.backend().addresses;
+
+  std::string input = "[\"abc\", 12.5, null, \"a\\nb\"]";
+  tokenizer.write(input);
+
+  ASSERT_EQ(tokens.size(), 9u);
+  ASSERT_EQ(tokens.at(1), Token(TokenType::StringLiteral, "\"abc\""));
+  ASSERT_EQ(addresses.at(1), input.data() + 1);
+  ASSERT_EQ(tokens.at(3), Token(TokenType::Number, "12.5"));
+  ASSERT_EQ(addresses.at(3), input.data() + 8);
+  ASSERT_EQ(tokens.at(5), Token(TokenType::Null, "null"));
+  ASSERT_EQ(addresses.at(5), input.data() + 14);
+
+  // escape sequences are rewritten in the tokenizer's buffer
+  ASSERT_EQ(tokens.at(7), Token(TokenType::StringLiteral, "\"a\nb\""));
+  ASSERT_TRUE(addresses.at(7) < input.data() || addresses.at(7) >= input.data() + input.size());
+
+  // a token split across several writes is copied
+  tokens.clear();
+  tokenizer.write("[\"ab");
+  tokenizer.write("cd\"]");
+  ASSERT_EQ(tokens.size(), 3u);
+  ASSERT_EQ(tokens.at(1), Token(TokenType::StringLiteral, "\"abcd\""));
+}
+
+TEST(parsing, structural_index_classify)
+{
+  using namespace json;
+
+  std::string block;
+  const char alphabet[] = "{}[]:,\"'\\ \nab01.e+-";
+
+  for (size_t i(0); i < 64; ++i)
+    block.push_back(alphabet[(i * 7 + i / 5) % (sizeof(alphabet) - 1)]);
+
+  details::BlockMasks expected;
+  details::classify_scalar(block.data(), expected);
+
+  for (SimdLevel level : { SimdLevel::SSE2, SimdLevel::AVX2 })
+  {
+    if (level > simd_level())
+      continue;
+
+    details::BlockMasks masks;
+    details::classify_function(level)(block.data(), masks);
+    ASSERT_EQ(masks.quote, expected.quote);
+    ASSERT_EQ(masks.single_quote, expected.single_quote);
+    ASSERT_EQ(masks.backslash, expected.backslash);
+    ASSERT_EQ(masks.op, expected.op);
+    ASSERT_EQ(masks.space, expected.space);
+    ASSERT_EQ(masks.newline, expected.newline);
+  }
+}
+
+TEST(parsing, structural_index)
+{
+  using namespace json;
+
+  std::string input = "{\"a\\\"\": [12, \"x y\"]}";
+  StructuralIndex index{ input.data(), input.size(), SimdLevel::Scalar };
+
+  std::vector<size_t> positions;
+
+  for (size_t pos = index.next(); pos != StructuralIndex::npos; pos = index.next())
+    positions.push_back(pos);
+
+  std::vector<size_t> expected{ 0, 1, 3, 5, 6, 8, 9, 11, 13, 17, 18, 19 };
+  ASSERT_EQ(positions, expected);
+}
+
+TEST(parsing, tokenizer_indexed)
+{
+  using namespace json;
+
+  std::string input = "[";
+
+  for (int i(0); i < 500; ++i)
+  {
+    input += "{ \"key" + std::to_string(i) + "\": \"val\\\\ue\\n\", id: -" + std::to_string(i) + ",\n";
+    input += "'single \"quoted\"': 1.5e-3, \"multi\\\\\\\"backslash\": [true, false, null], \"x\": \"\" },";
+  }
+
+  input += "{}]";
+
+  Tokenizer<ViewRecorderBackend> expected;
+  expected.write(input);
+  expected.done();
+
+  for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 })
+  {
+    if (level > simd_level())
+      continue;
+
+    // single-quoted strings are only met after the first chunk
+    const size_t chunk = input.find('\'') + 1;
+
+    Tokenizer<ViewRecorderBackend> tokenizer;
+    tokenizer.writeIndexed(input.data(), input.data() + chunk);
+    tokenizer.writeIndexed(input.data() + chunk, input.data() + input.size());
+    tokenizer.done();
+
+    ASSERT_EQ(tokenizer.backend().tokens.size(), expected.backend().tokens.size());
+    ASSERT_TRUE(tokenizer.backend().tokens == expected.backend().tokens);
+  }
+
+  Tokenizer<ViewRecorderBackend> tokenizer;
+  tokenizer.writeIndexed("[12, tr");
+  tokenizer.writeIndexed("ue, \"ab");
+  tokenizer.writeIndexed("c\"]");
+  ASSERT_EQ(tokenizer.backend().tokens.size(), 7u);
+  ASSERT_EQ(tokenizer.backend().tokens.at(3), Token(TokenType::True, "true"));
+  ASSERT_EQ(tokenizer.backend().tokens.at(5), Token(TokenType::StringLiteral, "\"abc\""));
+
+  ASSERT_ANY_THROW(tokenizer.writeIndexed("[12a]"));
+  ASSERT_ANY_THROW(tokenizer.writeIndexed("[\"a\nb\"]"));
+}
+
+TEST(parsing, parse_indexed)
+{
+  json::Json value = json::parse("{ \"name\": \"Bob\", 'age': 42, \"langs\": [\"C++\", \"J\\\"SON\"], pi: 3.14 }");
+
+  ASSERT_EQ(value["name"], "Bob");
+  ASSERT_EQ(value["age"], 42);
+  ASSERT_EQ(value["langs"].at(1), "J\"SON");
+  ASSERT_EQ(value["pi"], 3.14);
+
+  ASSERT_ANY_THROW(json::parse("[1, #]"));
+}
+
+TEST(parsing, tokenizer_long_strings)
+{
+  using namespace json;
+
+  const std::string text = "The quick brown fox jumps over the lazy dog";
+
+  Tokenizer<ViewRecorderBackend> tokenizer;
+  auto& tokens = tokenizer.backend().tokens;
+
+  std::string input = "\"" + text + "\" '" + text + "' \"" + text + "\\t" + text + "\" \"" + text;
+  tokenizer.write(input);
+  tokenizer.write(text + "\" ");
+
+  ASSERT_EQ(tokens.size(), 4u);
+  ASSERT_EQ(tokens.at(0), Token(TokenType::StringLiteral, "\"" + text + "\""));
+  ASSERT_EQ(tokens.at(1), Token(TokenType::StringLiteral, "'" + text + "'"));
+  ASSERT_EQ(tokens.at(2), Token(TokenType::StringLiteral, "\"" + text + "\t" + text + "\""));
+  ASSERT_EQ(tokens.at(3), Token(TokenType::StringLiteral, "\"" + text + text + "\""));
+
+  ASSERT_ANY_THROW(tokenizer.write("\"" + text + "\n"));
+}
+
+TEST(parsing, read_integer)
+{
+  using namespace json;
+
+  int value = 0;
+  ASSERT_EQ(read_integer("0", &value), NumberError::None);
+  ASSERT_EQ(value, 0);
+  ASSERT_EQ(read_integer("-125", &value), NumberError::None);
+  ASSERT_EQ(value, -125);
+  ASSERT_EQ(read_integer("+0042", &value), NumberError::None);
+  ASSERT_EQ(value, 42);
+  ASSERT_EQ(read_integer("2147483647", &value), NumberError::None);
+  ASSERT_EQ(value, 2147483647);
+  ASSERT_EQ(read_integer("-2147483648", &value), NumberError::None);
+  ASSERT_EQ(value, -2147483647 - 1);
+
+  ASSERT_EQ(read_integer("2147483648", &value), NumberError::OutOfRange);
+  ASSERT_EQ(read_integer("-2147483649", &value), NumberError::OutOfRange);
+  ASSERT_EQ(read_integer("1234567890123", &value), NumberError::OutOfRange);
+  ASSERT_EQ(read_integer("", &value), NumberError::InvalidInput);
+  ASSERT_EQ(read_integer("-", &value), NumberError::InvalidInput);
+  ASSERT_EQ(read_integer("--5", &value), NumberError::InvalidInput);
+  ASSERT_EQ(read_integer("12a", &value), NumberError::InvalidInput);
+  ASSERT_EQ(read_integer("123456789012a", &value), NumberError::InvalidInput);
+}
+
+TEST(parsing, read_number)
+{
+  using namespace json;
+
+  double value = 0;
+  ASSERT_EQ(read_number("3.14", &value), NumberError::None);
+  ASSERT_EQ(value, 3.14);
+  ASSERT_EQ(read_number("-2.45e-27", &value), NumberError::None);
+  ASSERT_EQ(value, -2.45e-27);
+  ASSERT_EQ(read_number("1e+28", &value), NumberError::None);
+  ASSERT_EQ(value, 1e28);
+  ASSERT_EQ(read_number("1.", &value), NumberError::None);
+  ASSERT_EQ(value, 1.0);
+  ASSERT_EQ(read_number("0.1000000000000000055511151231257827021181583404541015625", &value), NumberError::None);
+  ASSERT_EQ(value, 0.1);
+  ASSERT_EQ(read_number("9007199254740993", &value), NumberError::None);
+  ASSERT_EQ(value, 9007199254740992.0);
+  ASSERT_EQ(read_number("2.2250738585072014e-308", &value), NumberError::None);
+  ASSERT_EQ(value, 2.2250738585072014e-308);
+  ASSERT_EQ(read_number("4.9e-324", &value), NumberError::None);
+  ASSERT_EQ(value, 4.9e-324);
+  ASSERT_EQ(read_number("1e-400", &value), NumberError::None);
+  ASSERT_EQ(value, 0.0);
+  ASSERT_EQ(read_number("1.7976931348623157e308", &value), NumberError::None);
+  ASSERT_EQ(value, 1.7976931348623157e308);
+
+  ASSERT_EQ(read_number("1e400", &value), NumberError::OutOfRange);
+  ASSERT_EQ(read_number("1e", &value), NumberError::InvalidInput);
+  ASSERT_EQ(read_number("1.5e+-3", &value), NumberError::InvalidInput);
+  ASSERT_EQ(read_number(".5", &value), NumberError::InvalidInput);
+
+  // round-trip of values printed with 17 significant digits
+  uint64_t state = 88172645463325252ull;
+
+  for (int i(0); i < 100000; ++i)
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    double expected;
+    std::memcpy(&expected, &state, sizeof(double));
+
+    if (expected != expected || expected - expected != 0)
+      continue;
+
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", expected);
+
+    ASSERT_EQ(read_number(buffer, &value), NumberError::None) << buffer;
+    ASSERT_EQ(value, expected) << buffer;
+  }
+}
+
+TEST(parsing, write_number)
+{
+  using namespace json;
+
+  char buffer[32] = {};
+  ASSERT_EQ(std::string(buffer, write_integer(0, buffer)), "0");
+  ASSERT_EQ(std::string(buffer, write_integer(-125, buffer)), "-125");
+  ASSERT_EQ(std::string(buffer, write_integer(2147483647, buffer)), "2147483647");
+  ASSERT_EQ(std::string(buffer, write_integer(-2147483647 - 1, buffer)), "-2147483648");
+
+  ASSERT_EQ(std::string(buffer, write_number(3.14, buffer)), "3.14");
+  ASSERT_EQ(std::string(buffer, write_number(0.1, buffer)), "0.1");
+  ASSERT_EQ(std::string(buffer, write_number(1.0 / 3, buffer)), "0.3333333333333333");
+  ASSERT_EQ(std::string(buffer, write_number(1.0, buffer)), "1.0");
+  ASSERT_EQ(std::string(buffer, write_number(-1500.0, buffer)), "-1500.0");
+  ASSERT_EQ(std::string(buffer, write_number(-0.0, buffer)), "-0.0");
+  ASSERT_EQ(std::string(buffer, write_number(0.000001, buffer)), "0.000001");
+  ASSERT_EQ(std::string(buffer, write_number(1e-7, buffer)), "1e-7");
+  ASSERT_EQ(std::string(buffer, write_number(1e21, buffer)), "1e+21");
+  ASSERT_EQ(std::string(buffer, write_number(5e-324, buffer)), "5e-324");
+  ASSERT_EQ(std::string(buffer, write_number(1.7976931348623157e308, buffer)), "1.7976931348623157e+308");
+  ASSERT_THROW(write_number(std::numeric_limits<double>::quiet_NaN(), buffer), std::runtime_error);
+  ASSERT_THROW(write_number(std::numeric_limits<double>::infinity(), buffer), std::runtime_error);
+  ASSERT_THROW(write_number(-std::numeric_limits<double>::infinity(), buffer), std::runtime_error);
+
+  // shortest round-trip
+  uint64_t state = 88172645463325252ull;
+
+  for (int i(0); i < 100000; ++i)
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    double expected;
+    std::memcpy(&expected, &state, sizeof(double));
+
+    if (expected != expected || expected - expected != 0)
+      continue;
+
+    const std::string text{ buffer, write_number(expected, buffer) };
+
+    double value = 0;
+    ASSERT_EQ(read_number(text, &value), NumberError::None) << text;
+    ASSERT_EQ(std::memcmp(&value, &expected, sizeof(double)), 0) << text;
+  }
+}
+
+TEST(parsing, parse_numbers)
+{
+  json::Json value = json::parse("[2147483647, 2147483648, -1.5e3, 1e-2]");
+
+  ASSERT_EQ(value.at(0), 2147483647);
+  ASSERT_EQ(value.at(1), 2147483648.0);
+  ASSERT_EQ(value.at(2), -1500.0);
+  ASSERT_EQ(value.at(3), 0.01);
+
+  // numbers too large for a double are rejected rather than read as infinities
+  ASSERT_THROW(json::parse("[1e400]"), std::runtime_error);
+  ASSERT_THROW(json::parse("[-1e400]"), std::runtime_error);
+  ASSERT_THROW(json::parse("[" + std::string(400, '9') + "]"), std::runtime_error);
+}
+
+TEST(parsing, arena)
+{
+  json::Arena arena{ 256 };
+
+  void* a = arena.allocate(3, 1);
+  void* b = arena.allocate(8, 8);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(b) % 8, 0);
+  ASSERT_TRUE(static_cast<char*>(b) >= static_cast<char*>(a) + 3);
+  ASSERT_EQ(arena.capacity(), 256u);
+
+  // large blocks do not waste the current chunk
+  arena.allocate(1000, 8);
+  ASSERT_TRUE(arena.capacity() > 1256);
+  void* c = arena.allocate(8, 8);
+  ASSERT_EQ(static_cast<char*>(c), static_cast<char*>(b) + 8);
+
+  arena.reset();
+  ASSERT_EQ(arena.capacity(), 256u);
+}
+
+TEST(parsing, document)
+{
+  const std::string input = "{ \"name\": \"a string that does not fit in the small string buffer\", "
+    "\"values\": [1, 2.5, true, null, { \"nested\": [\"a\", \"b\"] }] }";
+
+  json::Document doc;
+  doc.parse(input);
+
+  ASSERT_TRUE(doc.root().isObject());
+  ASSERT_EQ(doc.root(), json::parse(input));
+  ASSERT_EQ(doc.root()["values"].length(), 5);
+  ASSERT_EQ(doc.root()["values"].at(4)["nested"].at(1), "b");
+
+  // values can be added to the tree
+  {
+    json::Array values = doc.root()["values"].toArray();
+    values.push(json::Object());
+    values.push(json::Array(doc.arena()));
+    ASSERT_EQ(values.length(), 7);
+  }
+
+  doc.parse("[1, 2, 3]");
+  ASSERT_TRUE(doc.root().isArray());
+  ASSERT_EQ(doc.root().length(), 3);
+}
+
+TEST(parsing, keys)
+{
+  using namespace json;
+
+  Key small{ "id" };
+  ASSERT_FALSE(small.isShared());
+  ASSERT_EQ(small.size(), 2u);
+  ASSERT_EQ(small, Key("id"));
+  ASSERT_NE(small, Key("ids"));
+  ASSERT_EQ(Key(std::string(15, 'a')).size(), 15u);
+  ASSERT_FALSE(Key(std::string(15, 'a')).isShared());
+
+  const std::string long_name = "a key that is too long to be stored inline";
+  Key a{ long_name };
+  Key b{ long_name };
+  ASSERT_TRUE(a.isShared());
+  ASSERT_NE(a.data(), b.data());
+  ASSERT_EQ(a, b);
+  ASSERT_EQ(a.str(), long_name);
+
+  {
+    KeyPool pool;
+    a = pool.intern(long_name);
+    b = pool.intern(long_name);
+    ASSERT_EQ(a.data(), b.data());
+    ASSERT_EQ(pool.intern("id"), small);
+    ASSERT_EQ(pool.size(), 1u);
+  }
+
+  // keys outlive their pool
+  ASSERT_EQ(a, b);
+  ASSERT_EQ(a.str(), long_name);
+}
+
+TEST(parsing, parse_interned_keys)
+{
+  const std::string input = "[{ \"a_rather_long_field_name\": 1, \"id\": 1 }, { \"a_rather_long_field_name\": 2, \"id\": 2 }]";
+
+  json::Json value = json::parse(input);
+  auto first = json::JsonView(value).at(0).fields().begin();
+  auto second = json::JsonView(value).at(1).fields().begin();
+  ASSERT_EQ(first->first.data(), second->first.data());
+  ASSERT_EQ(value.at(1)["a_rather_long_field_name"], 2);
+
+  // a pool shared between parses
+  json::KeyPool pool;
+  json::Json a = json::parse(input, pool);
+  json::Json b = json::parse(input, pool);
+  ASSERT_EQ(pool.size(), 1u);
+  ASSERT_EQ(json::JsonView(a).at(0).fields().begin()->first.data(), json::JsonView(b).at(1).fields().begin()->first.data());
+  ASSERT_EQ(a, b);
+  ASSERT_EQ(a, value);
+
+  json::Document doc;
+  doc.parse(input);
+  doc.parse(input);
+  ASSERT_EQ(doc.keys().size(), 1u);
+  ASSERT_EQ(doc.root(), value);
+}
+
+TEST(parsing, deduplication)
+{
+  std::string input = "[";
+  for (int i(0); i < 100; ++i)
+    input += std::string(i ? ", " : "") + "{ \"config\": { \"retries\": 3, \"mode\": \"a rather long mode name\" }, \"id\": " + std::to_string(i % 10) + " }";
+  input += "]";
+
+  json::Json value = json::parse(input);
+  const json::Json reference = json::parse(input);
+  json::DeduplicationReport report = json::deduplicate(value);
+
+  ASSERT_EQ(value, reference);
+  ASSERT_EQ(report.unique, 13u);
+  ASSERT_EQ(report.duplicates, 99u + 99u + 90u);
+  ASSERT_GT(report.bytes_saved, 0u);
+  ASSERT_EQ(value.at(0).impl(), value.at(10).impl());
+  ASSERT_EQ(value.at(1)["config"].impl(), value.at(2)["config"].impl());
+  ASSERT_NE(value.at(1).impl(), value.at(2).impl());
+
+  // the shared subtrees are copied on write
+  ASSERT_TRUE(value.isFrozen());
+  json::Json modified = value;
+  modified[1]["config"]["retries"] = 5;
+  ASSERT_EQ(value, reference);
+  ASSERT_EQ(modified[1]["config"]["retries"], 5);
+  ASSERT_EQ(modified.at(2)["config"], reference.at(2)["config"]);
+  ASSERT_EQ(modified.at(11)["config"]["retries"], 3);
+
+  // parse-time deduplication
+  json::Deduplicator deduplicator;
+  json::Json parsed = json::parse(input, deduplicator);
+  ASSERT_EQ(parsed, reference);
+  ASSERT_EQ(parsed.at(3).impl(), parsed.at(93).impl());
+  ASSERT_EQ(deduplicator.report().unique, 13u);
+  ASSERT_EQ(deduplicator.report().duplicates, 99u + 99u + 90u);
+
+  json::Document doc;
+  doc.parse(input);
+  report = json::deduplicate(doc);
+  ASSERT_EQ(doc.root(), reference);
+  ASSERT_EQ(doc.root().at(5).impl(), doc.root().at(15).impl());
+  // the values are interned bottom-up, as during parsing
+  ASSERT_EQ(report.duplicates, 99u + 99u + 90u);
+}